@@ -55,6 +55,19 @@ bool isBoxIntersectingBox(const box_t & a, const box_t & b) {
 			&& b.getMaxY() > a.getMinY() && b.getMinZ() < a.getMaxZ() && b.getMaxZ() > a.getMinZ();
 }
 
+/**
+ * Check if two boxes intersect or touch each other.
+ * In contrast to isBoxIntersectingBox(), boxes sharing only a face, an edge, or a corner are reported, too.
+ *
+ * @param a First box
+ * @param b Second box
+ */
+template <class box_t>
+bool isBoxTouchingBox(const box_t & a, const box_t & b) {
+	return b.getMinX() <= a.getMaxX() && b.getMaxX() >= a.getMinX() && b.getMinY() <= a.getMaxY()
+			&& b.getMaxY() >= a.getMinY() && b.getMinZ() <= a.getMaxZ() && b.getMaxZ() >= a.getMinZ();
+}
+
 /**
  * Calculate the intersection of two boxes.
  *
@@ -0,0 +1,1071 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#ifndef GEOMETRY_COMPACTPOINTOCTREE_H
+#define GEOMETRY_COMPACTPOINTOCTREE_H
+
+#include "Box.h"
+#include "BoxIntersection.h"
+#include "MappedFile.h"
+#include "Morton.h"
+#include "PointOctree.h"
+#include "Sphere.h"
+#include "Vec3.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define GEOMETRY_POINT_FILTER_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GEOMETRY_POINT_FILTER_SSE
+#endif
+
+namespace Geometry {
+
+/**
+ * Read-only variant of PointOctree with a flat memory layout.
+ * All nodes are stored in one array and addressed by index; the children of a node are stored consecutively.
+ * All points are stored in one contiguous array in depth-first order, so every node (not only leaves) covers a
+ * [begin,end) range of that array containing the points of its subtree.
+ * The tree is built once from a PointOctree and has the same structure and query interface.
+ * A tree of trivially copyable points can be saved to a file and loaded without copying by mapping the file into
+ * memory (see saveToFile() and loadFromFile()). Copies of a tree share its immutable arrays.
+ *
+ * @note The number of points is limited to 2^32-1.
+ */
+template <typename Point_t>
+class CompactPointOctree {
+public:
+	using point_t = Point_t;
+	//! Stack of node indices used by the traversal of a query. Reuse it between queries to avoid allocations.
+	using traversal_stack_t = std::vector<uint32_t>;
+
+	//! Flattened octree cell.
+	struct Node {
+		Box box; //!< Bounding box of the cell.
+		uint32_t firstChild; //!< Index of the first child node.
+		uint32_t childCount; //!< Number of consecutive child nodes; zero for leaf cells.
+		uint32_t begin; //!< Index of the first point of the subtree.
+		uint32_t end; //!< Index behind the last point of the subtree.
+
+		bool isLeaf() const {
+			return childCount == 0;
+		}
+		bool hasChildren() const {
+			return childCount != 0;
+		}
+		uint32_t size() const {
+			return end - begin;
+		}
+	};
+
+	//! Read-only view of a contiguous array owned by the tree or located inside a mapped file.
+	template <typename T>
+	class ArrayView {
+	private:
+		const T * first;
+		std::size_t count;
+
+	public:
+		ArrayView() : first(nullptr), count(0) {
+		}
+		ArrayView(const T * _first, std::size_t _count) : first(_first), count(_count) {
+		}
+		const T * data() const {
+			return first;
+		}
+		std::size_t size() const {
+			return count;
+		}
+		bool empty() const {
+			return count == 0;
+		}
+		const T & operator[](std::size_t index) const {
+			return first[index];
+		}
+		const T & front() const {
+			return first[0];
+		}
+		const T * begin() const {
+			return first;
+		}
+		const T * end() const {
+			return first + count;
+		}
+	};
+
+	/**
+	 * Result of a batch query in compressed sparse row format.
+	 * The result of query @c i consists of the point indices <tt>indices[offsets[i], offsets[i + 1])</tt>.
+	 */
+	struct BatchResult {
+		std::vector<uint32_t> offsets; //!< One entry per query and a final entry with the total number of results.
+		std::vector<uint32_t> indices; //!< Indices into getPoints().
+	};
+
+private:
+	float minBoxSize; //!< Lower bound for side length of cell boundary.
+	uint32_t maxNumPoints; //!< Upper bound for number of points inside a leaf cell.
+
+	//! Owner of the memory of the arrays: either an OwnedArrays object or a MappedFile.
+	std::shared_ptr<const void> storage;
+	ArrayView<Node> nodes; //!< All cells; the root is stored at index zero.
+	ArrayView<Point_t> points; //!< All points in depth-first order of the cells.
+
+	//! Optional copies of the point coordinates as structure of arrays, used for vectorized filtering of leaves.
+	ArrayView<float> positionsX, positionsY, positionsZ;
+	bool positionArrays; //!< @c true if the position arrays are used.
+
+	//! Arrays of a tree built in memory.
+	struct OwnedArrays {
+		std::vector<Node> nodes;
+		std::vector<Point_t> points;
+		std::vector<float> positionsX, positionsY, positionsZ;
+	};
+
+	/**
+	 * Header of the file format. All arrays follow the header at the given offsets, which are aligned to
+	 * FILE_ALIGNMENT bytes. The data is stored in native byte order and layout.
+	 */
+	struct FileHeader {
+		char magic[8]; //!< "GEOCPOT" and a terminating zero.
+		uint32_t version; //!< Version of the file format.
+		uint32_t byteOrderMark; //!< BYTE_ORDER_MARK written in native byte order.
+		uint32_t nodeSize; //!< sizeof(Node)
+		uint32_t pointSize; //!< sizeof(Point_t)
+		uint32_t pointAlignment; //!< alignof(Point_t)
+		uint32_t flags; //!< Bit zero is set if the position arrays are stored.
+		float minBoxSize;
+		uint32_t maxNumPoints;
+		uint64_t nodeCount;
+		uint64_t pointCount;
+		uint64_t nodeOffset;
+		uint64_t pointOffset;
+		uint64_t positionsOffset; //!< Offset of the x array; the y and z arrays follow at aligned offsets.
+	};
+	static const uint32_t FILE_VERSION = 1;
+	static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+	static const uint64_t FILE_ALIGNMENT = 64;
+	static uint64_t alignFileOffset(uint64_t offset) {
+		return (offset + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+	}
+
+	//! Create an empty tree; used by loadFromFile().
+	CompactPointOctree() : minBoxSize(0.0f), maxNumPoints(0), positionArrays(false) {
+	}
+
+	static void build(uint32_t nodeIndex, const PointOctree<Point_t> & cell, OwnedArrays & arrays);
+
+	/**
+	 * Best-first k-nearest-neighbor search.
+	 *
+	 * @param epsilon Nodes farther away than the current k-th distance divided by <tt>1 + epsilon</tt> are pruned.
+	 * @param[out] result Pairs of squared distance and point index, ordered by increasing distance.
+	 */
+	inline void findClosestPoints(const Vec3f & pos, uint64_t count, float epsilon,
+								  std::vector<std::pair<float, uint32_t>> & result) const;
+
+	//! Return a key for sorting query positions along a Z-order curve through the bounding box.
+	uint32_t getLocalityKey(const Vec3f & pos) const {
+		const Box & bounds = getBox();
+		const auto quantize = [](float value, float min, float extent) -> uint32_t {
+			const float relative = extent > 0.0f ? (value - min) / extent : 0.0f;
+			return static_cast<uint32_t>(std::min(std::max(relative, 0.0f), 1.0f) * 1023.0f);
+		};
+		const uint32_t x = quantize(pos.x(), bounds.getMinX(), bounds.getExtentX());
+		const uint32_t y = quantize(pos.y(), bounds.getMinY(), bounds.getExtentY());
+		const uint32_t z = quantize(pos.z(), bounds.getMinZ(), bounds.getExtentZ());
+		return Morton::encode32(x, y, z);
+	}
+
+	/**
+	 * Execute a batch of queries.
+	 *
+	 * @param positions Representative position of every query, used for ordering.
+	 * @param query Function <tt>(queryIndex, traversalStack, std::vector<uint32_t> & out)</tt> appending the
+	 * resulting point indices of a single query.
+	 */
+	template <typename Query_t>
+	void executeBatch(const std::vector<Vec3f> & positions, const Query_t & query, BatchResult & result,
+					  unsigned int numThreads) const;
+
+	//! Return @c true if the box lies completely inside the sphere.
+	static bool isBoxInsideSphere(const Box & box, const Sphere_f & sphere) {
+		const Vec3f & center = sphere.getCenter();
+		const float dx = std::max(center.x() - box.getMinX(), box.getMaxX() - center.x());
+		const float dy = std::max(center.y() - box.getMinY(), box.getMaxY() - center.y());
+		const float dz = std::max(center.z() - box.getMinZ(), box.getMaxZ() - center.z());
+		return dx * dx + dy * dy + dz * dz <= sphere.getRadius() * sphere.getRadius();
+	}
+
+	//! Call the visitor for the points <tt>first + j</tt> with bit @c j set in @p mask.
+	template <typename Visitor_t>
+	bool visitMasked(uint32_t first, uint32_t mask, Visitor_t & visitor) const {
+		for (uint32_t j = 0; mask != 0; ++j, mask >>= 1) {
+			if ((mask & 1) != 0 && !visitor(points[first + j])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//! Call the visitor for the points of the leaf within the box; vectorized if position arrays are available.
+	template <typename Visitor_t>
+	inline bool visitLeafWithinBox(const Node & leaf, const Box & queryBox, Visitor_t & visitor) const;
+	//! Call the visitor for the points of the leaf within the sphere; vectorized if position arrays are available.
+	template <typename Visitor_t>
+	inline bool visitLeafWithinSphere(const Node & leaf, const Sphere_f & sphere, Visitor_t & visitor) const;
+
+	template <typename Visitor_t>
+	bool visitRange(uint32_t begin, uint32_t end, Visitor_t & visitor) const {
+		for (uint32_t i = begin; i < end; ++i) {
+			if (!visitor(points[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+public:
+	/**
+	 * Create a flattened copy of the given octree.
+	 *
+	 * @param octree Source octree. Its structure and the order of its points are preserved.
+	 * @param storePositionArrays If @c true, the coordinates of the points are additionally stored as separate
+	 * x/y/z arrays. The points of partially covered leaves are then tested with SSE/AVX instructions, several points
+	 * at once, at the cost of twelve additional bytes per point.
+	 */
+	explicit CompactPointOctree(const PointOctree<Point_t> & octree, bool storePositionArrays = false);
+
+	/**
+	 * @name Serialization
+	 * The file format stores the node array (including the point range of every node), the points and the optional
+	 * position arrays in native byte order. It is versioned and only available for trivially copyable points.
+	 */
+	//@{
+	/**
+	 * Write the tree to a file.
+	 * The file is written under a temporary name and then renamed, so that trees mapping a previous version of the
+	 * file stay valid.
+	 *
+	 * @throw std::runtime_error if the file cannot be written.
+	 */
+	inline void saveToFile(const std::string & path) const;
+
+	/**
+	 * Load a tree by mapping the file written by saveToFile() into memory. Nothing is copied: the queries work
+	 * directly on the mapped pages, which are loaded on first access and shared with other processes mapping the same
+	 * file. The mapping is released when the last copy of the tree is destroyed.
+	 *
+	 * @throw std::runtime_error if the file cannot be mapped, has a different version or point layout, or if the
+	 * point ranges or child indices of a node are out of bounds.
+	 */
+	inline static CompactPointOctree loadFromFile(const std::string & path);
+	//@}
+
+	//! Return @c true if the coordinates are stored as separate arrays for vectorized filtering.
+	bool hasPositionArrays() const {
+		return positionArrays;
+	}
+
+	const Box & getBox() const {
+		return nodes.front().box;
+	}
+	float getMinBoxSize() const {
+		return minBoxSize;
+	}
+	uint32_t getMaxNumPoints() const {
+		return maxNumPoints;
+	}
+	bool empty() const {
+		return points.empty();
+	}
+	//! Return the total number of points.
+	std::size_t size() const {
+		return points.size();
+	}
+	//! Return all nodes; the root is the first entry.
+	const ArrayView<Node> & getNodes() const {
+		return nodes;
+	}
+	//! Return all points in depth-first order.
+	const ArrayView<Point_t> & getPoints() const {
+		return points;
+	}
+
+	/**
+	 * Return all points.
+	 *
+	 * @param out Points in the tree.
+	 */
+	void collectPoints(std::deque<Point_t> & out) const {
+		std::copy(points.begin(), points.end(), std::back_inserter(out));
+	}
+
+	/**
+	 * Return all points where the location is within the given box.
+	 *
+	 * @param box
+	 * @param out Points that fulfill the condition are added to this container.
+	 */
+	inline void collectPointsWithinBox(const Box & box, std::deque<Point_t> & out) const;
+
+	/**
+	 * Return all points where the location is within the sphere.
+	 *
+	 * @param sphere The sphere describing the query region.
+	 * @param out Points that fulfill the condition are added to this container.
+	 */
+	inline void collectPointsWithinSphere(const Sphere_f & sphere, std::deque<Point_t> & out) const;
+
+	/**
+	 * @name Visitor queries
+	 * The visitor is called with a const reference to every point fulfilling the condition and returns @c false to
+	 * stop the traversal. The functions return @c false if the traversal has been stopped by the visitor.
+	 * Passing a traversal stack that is reused between queries avoids all heap allocations of the traversal.
+	 * @see PointOctree::visitPoints
+	 */
+	//@{
+	template <typename Visitor_t>
+	bool visitPoints(Visitor_t && visitor) const {
+		return visitRange(0, static_cast<uint32_t>(points.size()), visitor);
+	}
+
+	template <typename Visitor_t>
+	inline bool visitPointsWithinBox(const Box & box, Visitor_t && visitor, traversal_stack_t & activeCells) const;
+	template <typename Visitor_t>
+	bool visitPointsWithinBox(const Box & box, Visitor_t && visitor) const {
+		traversal_stack_t activeCells;
+		return visitPointsWithinBox(box, std::forward<Visitor_t>(visitor), activeCells);
+	}
+
+	template <typename Visitor_t>
+	inline bool visitPointsWithinSphere(const Sphere_f & sphere, Visitor_t && visitor,
+										traversal_stack_t & activeCells) const;
+	template <typename Visitor_t>
+	bool visitPointsWithinSphere(const Sphere_f & sphere, Visitor_t && visitor) const {
+		traversal_stack_t activeCells;
+		return visitPointsWithinSphere(sphere, std::forward<Visitor_t>(visitor), activeCells);
+	}
+	//@}
+
+	/**
+	 * Return the leaf node containing the given point or nullptr if the point is outside the tree.
+	 *
+	 * @param point Point
+	 * @return Leaf node or nullptr.
+	 */
+	const Node * findLeafCell(const Vec3f & point) const {
+		const Node * cell = &nodes.front();
+		if (!cell->box.contains(point)) {
+			return nullptr;
+		}
+		while (cell->hasChildren()) {
+			const Node * child = &nodes[cell->firstChild];
+			const Node * const childrenEnd = child + cell->childCount;
+			while (child != childrenEnd && !child->box.contains(point)) {
+				++child;
+			}
+			if (child == childrenEnd) {
+				return nullptr;
+			}
+			cell = child;
+		}
+		return cell;
+	}
+
+	/**
+	 * Return the @p count points closest to the given position.
+	 *
+	 * @param pos Query position. If it is outside of the octree, @p out is not changed.
+	 * @param count Maximum number of points to return.
+	 * @param out Is cleared and filled with the closest points ordered by increasing distance.
+	 * @see PointOctree::getClosestPoints
+	 */
+	inline void getClosestPoints(const Vec3f & pos, uint64_t count, std::deque<Point_t> & out) const;
+
+	//! Return the @p count points closest to the given position ordered by increasing distance.
+	inline std::deque<Point_t> getSortedClosestPoints(const Vec3f & pos, uint64_t count) const;
+
+	/**
+	 * Return @p count points that are approximately the closest points to the given position.
+	 *
+	 * @param epsilon Allowed relative distance error; zero gives the same result as getClosestPoints().
+	 * @throw std::invalid_argument if @p epsilon is negative.
+	 * @see PointOctree::getApproximateClosestPoints
+	 */
+	inline void getApproximateClosestPoints(const Vec3f & pos, uint64_t count, float epsilon,
+											std::deque<Point_t> & out) const;
+
+	/**
+	 * @name Batch queries
+	 * Execute many queries at once and store the results as indices into getPoints().
+	 * The queries are processed in the order of a space-filling curve through their positions, so that consecutive
+	 * queries touch the same nodes. Chunks of queries can be distributed to multiple threads. The result does not
+	 * depend on the number of threads. If a query throws, the remaining queries are skipped and the first exception
+	 * is rethrown on the calling thread after all threads have been joined.
+	 */
+	//@{
+	//! Collect the indices of all points within each of the spheres. Zero threads use all hardware threads.
+	inline void collectPointIndicesWithinSpheres(const std::vector<Sphere_f> & spheres, BatchResult & result,
+												 unsigned int numThreads = 1) const;
+	//! Collect the indices of all points within each of the boxes. Zero threads use all hardware threads.
+	inline void collectPointIndicesWithinBoxes(const std::vector<Box> & boxes, BatchResult & result,
+											   unsigned int numThreads = 1) const;
+	/**
+	 * Collect the indices of the @p count closest points to each of the positions, ordered by increasing distance.
+	 * Like getClosestPoints(), the result is empty for positions outside of the tree's box.
+	 * Zero threads use all hardware threads.
+	 */
+	inline void getClosestPointIndices(const std::vector<Vec3f> & positions, uint64_t count, BatchResult & result,
+									   unsigned int numThreads = 1) const;
+	//@}
+};
+
+template <typename Point_t>
+CompactPointOctree<Point_t>::CompactPointOctree(const PointOctree<Point_t> & octree, bool storePositionArrays)
+		: minBoxSize(octree.getMinBoxSize()), maxNumPoints(octree.getMaxNumPoints()),
+		  positionArrays(storePositionArrays) {
+	std::shared_ptr<OwnedArrays> arrays = std::make_shared<OwnedArrays>();
+	arrays->nodes.resize(1);
+	build(0, octree, *arrays);
+	if (storePositionArrays) {
+		arrays->positionsX.reserve(arrays->points.size());
+		arrays->positionsY.reserve(arrays->points.size());
+		arrays->positionsZ.reserve(arrays->points.size());
+		for (const auto & p : arrays->points) {
+			arrays->positionsX.push_back(p.getPosition().x());
+			arrays->positionsY.push_back(p.getPosition().y());
+			arrays->positionsZ.push_back(p.getPosition().z());
+		}
+	}
+	nodes = ArrayView<Node>(arrays->nodes.data(), arrays->nodes.size());
+	points = ArrayView<Point_t>(arrays->points.data(), arrays->points.size());
+	positionsX = ArrayView<float>(arrays->positionsX.data(), arrays->positionsX.size());
+	positionsY = ArrayView<float>(arrays->positionsY.data(), arrays->positionsY.size());
+	positionsZ = ArrayView<float>(arrays->positionsZ.data(), arrays->positionsZ.size());
+	storage = std::move(arrays);
+}
+
+template <typename Point_t>
+inline void CompactPointOctree<Point_t>::saveToFile(const std::string & path) const {
+	static_assert(std::is_trivially_copyable<Point_t>::value, "Only trivially copyable points can be saved.");
+	FileHeader header;
+	std::memset(&header, 0, sizeof(FileHeader));
+	std::memcpy(header.magic, "GEOCPOT", 8);
+	header.version = FILE_VERSION;
+	header.byteOrderMark = BYTE_ORDER_MARK;
+	header.nodeSize = sizeof(Node);
+	header.pointSize = sizeof(Point_t);
+	header.pointAlignment = alignof(Point_t);
+	header.flags = positionArrays ? 1 : 0;
+	header.minBoxSize = minBoxSize;
+	header.maxNumPoints = maxNumPoints;
+	header.nodeCount = nodes.size();
+	header.pointCount = points.size();
+	header.nodeOffset = alignFileOffset(sizeof(FileHeader));
+	header.pointOffset = alignFileOffset(header.nodeOffset + nodes.size() * sizeof(Node));
+	header.positionsOffset = alignFileOffset(header.pointOffset + points.size() * sizeof(Point_t));
+
+	// write a temporary file and rename it, as truncating a mapped file would invalidate the pages of its readers
+	const std::string tempPath = path + ".tmp";
+	std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+	uint64_t offset = 0;
+	const auto writeAt = [&](uint64_t position, const void * data, std::size_t size) {
+		static const char padding[FILE_ALIGNMENT] = {0};
+		out.write(padding, static_cast<std::streamsize>(position - offset));
+		out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+		offset = position + size;
+	};
+	writeAt(0, &header, sizeof(FileHeader));
+	writeAt(header.nodeOffset, nodes.data(), nodes.size() * sizeof(Node));
+	writeAt(header.pointOffset, points.data(), points.size() * sizeof(Point_t));
+	if (positionArrays) {
+		const uint64_t arraySize = alignFileOffset(points.size() * sizeof(float));
+		writeAt(header.positionsOffset, positionsX.data(), points.size() * sizeof(float));
+		writeAt(header.positionsOffset + arraySize, positionsY.data(), points.size() * sizeof(float));
+		writeAt(header.positionsOffset + 2 * arraySize, positionsZ.data(), points.size() * sizeof(float));
+	}
+	out.close();
+	if (!out) {
+		std::remove(tempPath.c_str());
+		throw std::runtime_error("CompactPointOctree: cannot write \"" + path + "\"");
+	}
+	try {
+		MappedFile::replaceFile(tempPath, path);
+	} catch (...) {
+		std::remove(tempPath.c_str());
+		throw;
+	}
+}
+
+template <typename Point_t>
+inline CompactPointOctree<Point_t> CompactPointOctree<Point_t>::loadFromFile(const std::string & path) {
+	static_assert(std::is_trivially_copyable<Point_t>::value, "Only trivially copyable points can be loaded.");
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(path);
+	const auto fail = [&path](const std::string & reason) {
+		throw std::runtime_error("CompactPointOctree: cannot load \"" + path + "\": " + reason);
+	};
+	if (file->size() < sizeof(FileHeader)) {
+		fail("file too small");
+	}
+	FileHeader header;
+	std::memcpy(&header, file->data(), sizeof(FileHeader));
+	if (std::memcmp(header.magic, "GEOCPOT", 8) != 0) {
+		fail("unknown file type");
+	} else if (header.version != FILE_VERSION) {
+		fail("unsupported version");
+	} else if (header.byteOrderMark != BYTE_ORDER_MARK) {
+		fail("different byte order");
+	} else if (header.nodeSize != sizeof(Node) || header.pointSize != sizeof(Point_t)
+			   || header.pointAlignment != alignof(Point_t)) {
+		fail("different node or point layout");
+	} else if (header.nodeCount == 0) {
+		fail("no root node");
+	}
+	// bound all counts and offsets by the file size first, so that the following arithmetic cannot overflow
+	const uint64_t fileSize = file->size();
+	const uint64_t maxOffset = alignFileOffset(fileSize); // without position arrays, they start behind the file
+	if (header.nodeCount > fileSize / sizeof(Node) || header.pointCount > fileSize / sizeof(Point_t)
+		|| header.nodeOffset > maxOffset || header.pointOffset > maxOffset || header.positionsOffset > maxOffset) {
+		fail("truncated or corrupt file");
+	}
+	const uint64_t arraySize = alignFileOffset(header.pointCount * sizeof(float));
+	const uint64_t requiredSize = (header.flags & 1) != 0
+										  ? header.positionsOffset + 2 * arraySize + header.pointCount * sizeof(float)
+										  : header.pointOffset + header.pointCount * sizeof(Point_t);
+	if (header.nodeOffset % FILE_ALIGNMENT != 0 || header.pointOffset % FILE_ALIGNMENT != 0
+		|| header.positionsOffset % FILE_ALIGNMENT != 0
+		|| header.pointOffset < header.nodeOffset + header.nodeCount * sizeof(Node)
+		|| header.positionsOffset < header.pointOffset + header.pointCount * sizeof(Point_t)
+		|| fileSize < requiredSize) {
+		fail("truncated or corrupt file");
+	}
+	// the queries index the arrays without checks; children are stored behind their parent, so traversals terminate
+	const Node * const fileNodes = reinterpret_cast<const Node *>(file->data() + header.nodeOffset);
+	for (uint64_t i = 0; i < header.nodeCount; ++i) {
+		const Node & node = fileNodes[i];
+		if (node.begin > node.end || node.end > header.pointCount
+			|| (node.hasChildren()
+				&& (node.firstChild <= i
+					|| static_cast<uint64_t>(node.firstChild) + node.childCount > header.nodeCount))) {
+			fail("corrupt node");
+		}
+	}
+
+	CompactPointOctree tree;
+	tree.minBoxSize = header.minBoxSize;
+	tree.maxNumPoints = header.maxNumPoints;
+	tree.positionArrays = (header.flags & 1) != 0;
+	const uint8_t * const data = file->data();
+	tree.nodes = ArrayView<Node>(reinterpret_cast<const Node *>(data + header.nodeOffset),
+								 static_cast<std::size_t>(header.nodeCount));
+	tree.points = ArrayView<Point_t>(reinterpret_cast<const Point_t *>(data + header.pointOffset),
+									 static_cast<std::size_t>(header.pointCount));
+	if (tree.positionArrays) {
+		const float * const xs = reinterpret_cast<const float *>(data + header.positionsOffset);
+		tree.positionsX = ArrayView<float>(xs, tree.points.size());
+		tree.positionsY = ArrayView<float>(reinterpret_cast<const float *>(data + header.positionsOffset + arraySize),
+										   tree.points.size());
+		tree.positionsZ = ArrayView<float>(
+				reinterpret_cast<const float *>(data + header.positionsOffset + 2 * arraySize), tree.points.size());
+	}
+	tree.storage = std::move(file);
+	return tree;
+}
+
+template <typename Point_t>
+template <typename Visitor_t>
+inline bool CompactPointOctree<Point_t>::visitLeafWithinBox(const Node & leaf, const Box & queryBox,
+															 Visitor_t & visitor) const {
+	uint32_t i = leaf.begin;
+	if (positionArrays) {
+		const float * const xs = positionsX.data();
+		const float * const ys = positionsY.data();
+		const float * const zs = positionsZ.data();
+#if defined(GEOMETRY_POINT_FILTER_AVX)
+		const __m256 minX = _mm256_set1_ps(queryBox.getMinX()), maxX = _mm256_set1_ps(queryBox.getMaxX());
+		const __m256 minY = _mm256_set1_ps(queryBox.getMinY()), maxY = _mm256_set1_ps(queryBox.getMaxY());
+		const __m256 minZ = _mm256_set1_ps(queryBox.getMinZ()), maxZ = _mm256_set1_ps(queryBox.getMaxZ());
+		for (; i + 8 <= leaf.end; i += 8) {
+			const __m256 x = _mm256_loadu_ps(xs + i);
+			const __m256 y = _mm256_loadu_ps(ys + i);
+			const __m256 z = _mm256_loadu_ps(zs + i);
+			__m256 inside = _mm256_and_ps(_mm256_cmp_ps(x, minX, _CMP_GE_OQ), _mm256_cmp_ps(x, maxX, _CMP_LE_OQ));
+			inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(y, minY, _CMP_GE_OQ),
+														 _mm256_cmp_ps(y, maxY, _CMP_LE_OQ)));
+			inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(z, minZ, _CMP_GE_OQ),
+														 _mm256_cmp_ps(z, maxZ, _CMP_LE_OQ)));
+			if (!visitMasked(i, static_cast<uint32_t>(_mm256_movemask_ps(inside)), visitor)) {
+				return false;
+			}
+		}
+#elif defined(GEOMETRY_POINT_FILTER_SSE)
+		const __m128 minX = _mm_set1_ps(queryBox.getMinX()), maxX = _mm_set1_ps(queryBox.getMaxX());
+		const __m128 minY = _mm_set1_ps(queryBox.getMinY()), maxY = _mm_set1_ps(queryBox.getMaxY());
+		const __m128 minZ = _mm_set1_ps(queryBox.getMinZ()), maxZ = _mm_set1_ps(queryBox.getMaxZ());
+		for (; i + 4 <= leaf.end; i += 4) {
+			const __m128 x = _mm_loadu_ps(xs + i);
+			const __m128 y = _mm_loadu_ps(ys + i);
+			const __m128 z = _mm_loadu_ps(zs + i);
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(x, minX), _mm_cmple_ps(x, maxX));
+			inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(y, minY), _mm_cmple_ps(y, maxY)));
+			inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(z, minZ), _mm_cmple_ps(z, maxZ)));
+			if (!visitMasked(i, static_cast<uint32_t>(_mm_movemask_ps(inside)), visitor)) {
+				return false;
+			}
+		}
+#endif
+		for (; i < leaf.end; ++i) {
+			if (queryBox.contains(xs[i], ys[i], zs[i]) && !visitor(points[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+	for (; i < leaf.end; ++i) {
+		if (queryBox.contains(points[i].getPosition()) && !visitor(points[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename Point_t>
+template <typename Visitor_t>
+inline bool CompactPointOctree<Point_t>::visitLeafWithinSphere(const Node & leaf, const Sphere_f & sphere,
+																Visitor_t & visitor) const {
+	uint32_t i = leaf.begin;
+	if (positionArrays) {
+		const float * const xs = positionsX.data();
+		const float * const ys = positionsY.data();
+		const float * const zs = positionsZ.data();
+		const float radiusSquared = sphere.getRadius() * sphere.getRadius();
+		// same arithmetic as Sphere::isOutside() to get identical results
+#if defined(GEOMETRY_POINT_FILTER_AVX)
+		const __m256 centerX = _mm256_set1_ps(sphere.getCenter().x());
+		const __m256 centerY = _mm256_set1_ps(sphere.getCenter().y());
+		const __m256 centerZ = _mm256_set1_ps(sphere.getCenter().z());
+		const __m256 rSquared = _mm256_set1_ps(radiusSquared);
+		for (; i + 8 <= leaf.end; i += 8) {
+			const __m256 dx = _mm256_sub_ps(centerX, _mm256_loadu_ps(xs + i));
+			const __m256 dy = _mm256_sub_ps(centerY, _mm256_loadu_ps(ys + i));
+			const __m256 dz = _mm256_sub_ps(centerZ, _mm256_loadu_ps(zs + i));
+			const __m256 distSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+													 _mm256_mul_ps(dz, dz));
+			const __m256 inside = _mm256_cmp_ps(distSquared, rSquared, _CMP_NGT_UQ);
+			if (!visitMasked(i, static_cast<uint32_t>(_mm256_movemask_ps(inside)), visitor)) {
+				return false;
+			}
+		}
+#elif defined(GEOMETRY_POINT_FILTER_SSE)
+		const __m128 centerX = _mm_set1_ps(sphere.getCenter().x());
+		const __m128 centerY = _mm_set1_ps(sphere.getCenter().y());
+		const __m128 centerZ = _mm_set1_ps(sphere.getCenter().z());
+		const __m128 rSquared = _mm_set1_ps(radiusSquared);
+		for (; i + 4 <= leaf.end; i += 4) {
+			const __m128 dx = _mm_sub_ps(centerX, _mm_loadu_ps(xs + i));
+			const __m128 dy = _mm_sub_ps(centerY, _mm_loadu_ps(ys + i));
+			const __m128 dz = _mm_sub_ps(centerZ, _mm_loadu_ps(zs + i));
+			const __m128 distSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			const __m128 inside = _mm_cmpngt_ps(distSquared, rSquared);
+			if (!visitMasked(i, static_cast<uint32_t>(_mm_movemask_ps(inside)), visitor)) {
+				return false;
+			}
+		}
+#endif
+		for (; i < leaf.end; ++i) {
+			if (!sphere.isOutside(Vec3f(xs[i], ys[i], zs[i])) && !visitor(points[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+	for (; i < leaf.end; ++i) {
+		if (!sphere.isOutside(points[i].getPosition()) && !visitor(points[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename Point_t>
+void CompactPointOctree<Point_t>::build(uint32_t nodeIndex, const PointOctree<Point_t> & cell, OwnedArrays & arrays) {
+	std::vector<Node> & nodes = arrays.nodes;
+	std::vector<Point_t> & points = arrays.points;
+	const auto & children = cell.getChildren();
+	nodes[nodeIndex].box = cell.getBox();
+	nodes[nodeIndex].begin = static_cast<uint32_t>(points.size());
+	nodes[nodeIndex].childCount = static_cast<uint32_t>(children.size());
+	nodes[nodeIndex].firstChild = static_cast<uint32_t>(children.empty() ? 0 : nodes.size());
+	if (children.empty()) {
+		std::copy(cell.getPoints().begin(), cell.getPoints().end(), std::back_inserter(points));
+	} else {
+		// reserve consecutive slots for all children before descending
+		const uint32_t firstChild = static_cast<uint32_t>(nodes.size());
+		nodes.resize(nodes.size() + children.size());
+		for (uint32_t i = 0; i < children.size(); ++i) {
+			build(firstChild + i, children[i], arrays);
+		}
+	}
+	nodes[nodeIndex].end = static_cast<uint32_t>(points.size());
+}
+
+template <typename Point_t>
+template <typename Visitor_t>
+inline bool CompactPointOctree<Point_t>::visitPointsWithinBox(const Box & queryBox, Visitor_t && visitor,
+															   traversal_stack_t & activeCells) const {
+	activeCells.clear();
+	activeCells.push_back(0);
+	while (!activeCells.empty()) {
+		const Node & cell = nodes[activeCells.back()];
+		activeCells.pop_back();
+
+		if (!Intersection::isBoxTouchingBox(cell.box, queryBox)) {
+			continue;
+		} else if (queryBox.contains(cell.box)) {
+			if (!visitRange(cell.begin, cell.end, visitor)) {
+				activeCells.clear();
+				return false;
+			}
+		} else if (cell.hasChildren()) {
+			for (uint32_t i = 0; i < cell.childCount; ++i) {
+				activeCells.push_back(cell.firstChild + i);
+			}
+		} else {
+			if (!visitLeafWithinBox(cell, queryBox, visitor)) {
+				activeCells.clear();
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+template <typename Point_t>
+template <typename Visitor_t>
+inline bool CompactPointOctree<Point_t>::visitPointsWithinSphere(const Sphere_f & sphere, Visitor_t && visitor,
+																  traversal_stack_t & activeCells) const {
+	activeCells.clear();
+	activeCells.push_back(0);
+	const float radiusSquared = sphere.getRadius() * sphere.getRadius();
+	while (!activeCells.empty()) {
+		const Node & cell = nodes[activeCells.back()];
+		activeCells.pop_back();
+
+		if (cell.box.getDistanceSquared(sphere.getCenter()) > radiusSquared) {
+			continue;
+		} else if (isBoxInsideSphere(cell.box, sphere)) {
+			if (!visitRange(cell.begin, cell.end, visitor)) {
+				activeCells.clear();
+				return false;
+			}
+		} else if (cell.hasChildren()) {
+			for (uint32_t i = 0; i < cell.childCount; ++i) {
+				activeCells.push_back(cell.firstChild + i);
+			}
+		} else {
+			if (!visitLeafWithinSphere(cell, sphere, visitor)) {
+				activeCells.clear();
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+template <typename Point_t>
+inline void CompactPointOctree<Point_t>::collectPointsWithinBox(const Box & queryBox, std::deque<Point_t> & out) const {
+	visitPointsWithinBox(queryBox, [&out](const Point_t & p) {
+		out.push_back(p);
+		return true;
+	});
+}
+
+template <typename Point_t>
+inline void CompactPointOctree<Point_t>::collectPointsWithinSphere(const Sphere_f & sphere,
+																	std::deque<Point_t> & out) const {
+	visitPointsWithinSphere(sphere, [&out](const Point_t & p) {
+		out.push_back(p);
+		return true;
+	});
+}
+
+template <typename Point_t>
+inline void CompactPointOctree<Point_t>::findClosestPoints(const Vec3f & pos, uint64_t count, float epsilon,
+															std::vector<std::pair<float, uint32_t>> & result) const {
+	typedef std::pair<float, uint32_t> entry_t;
+	struct FartherFirst {
+		bool operator()(const entry_t & a, const entry_t & b) const {
+			return a.first > b.first;
+		}
+	};
+	struct CloserFirst {
+		bool operator()(const entry_t & a, const entry_t & b) const {
+			return a.first < b.first;
+		}
+	};
+	result.clear();
+	if (count == 0) {
+		return;
+	}
+	// node distances are scaled by (1 + epsilon)^2 before they are compared to the squared point distances
+	const float pruneFactor = (1.0f + epsilon) * (1.0f + epsilon);
+	// nodes ordered by their distance to pos; result is a max-heap holding the best candidates found so far
+	std::priority_queue<entry_t, std::vector<entry_t>, FartherFirst> activeCells;
+	activeCells.emplace(getBox().getDistanceSquared(pos), 0);
+	while (!activeCells.empty()) {
+		const entry_t entry = activeCells.top();
+		activeCells.pop();
+		if (result.size() == count && entry.first * pruneFactor > result.front().first) {
+			break; // all remaining nodes are farther away than the current k-th point
+		}
+		const Node & cell = nodes[entry.second];
+		if (cell.isLeaf()) {
+			for (uint32_t i = cell.begin; i < cell.end; ++i) {
+				const float distSquared = pos.distanceSquared(points[i].getPosition());
+				if (result.size() < count) {
+					result.emplace_back(distSquared, i);
+					std::push_heap(result.begin(), result.end(), CloserFirst());
+				} else if (distSquared < result.front().first) {
+					std::pop_heap(result.begin(), result.end(), CloserFirst());
+					result.back() = entry_t(distSquared, i);
+					std::push_heap(result.begin(), result.end(), CloserFirst());
+				}
+			}
+		} else {
+			for (uint32_t i = cell.firstChild; i < cell.firstChild + cell.childCount; ++i) {
+				const float distSquared = nodes[i].box.getDistanceSquared(pos);
+				if (result.size() < count || distSquared * pruneFactor <= result.front().first) {
+					activeCells.emplace(distSquared, i);
+				}
+			}
+		}
+	}
+	std::sort_heap(result.begin(), result.end(), CloserFirst());
+}
+
+template <typename Point_t>
+inline void CompactPointOctree<Point_t>::getClosestPoints(const Vec3f & pos, uint64_t count,
+														   std::deque<Point_t> & out) const {
+	if (!getBox().contains(pos)) {
+		return;
+	}
+	std::vector<std::pair<float, uint32_t>> closestPoints;
+	findClosestPoints(pos, count, 0.0f, closestPoints);
+	out.clear();
+	for (const auto & distanceIndexPair : closestPoints) {
+		out.push_back(points[distanceIndexPair.second]);
+	}
+}
+
+template <typename Point_t>
+inline void CompactPointOctree<Point_t>::getApproximateClosestPoints(const Vec3f & pos, uint64_t count,
+																	  float epsilon, std::deque<Point_t> & out) const {
+	if (!(epsilon >= 0.0f)) {
+		throw std::invalid_argument("CompactPointOctree: epsilon must not be negative");
+	}
+	if (!getBox().contains(pos)) {
+		return;
+	}
+	std::vector<std::pair<float, uint32_t>> closestPoints;
+	findClosestPoints(pos, count, epsilon, closestPoints);
+	out.clear();
+	for (const auto & distanceIndexPair : closestPoints) {
+		out.push_back(points[distanceIndexPair.second]);
+	}
+}
+
+template <typename Point_t>
+inline std::deque<Point_t> CompactPointOctree<Point_t>::getSortedClosestPoints(const Vec3f & pos,
+																			   uint64_t count) const {
+	// getClosestPoints() already returns the points ordered by distance
+	std::deque<Point_t> sortedClosestPoints;
+	getClosestPoints(pos, count, sortedClosestPoints);
+	return sortedClosestPoints;
+}
+
+template <typename Point_t>
+template <typename Query_t>
+void CompactPointOctree<Point_t>::executeBatch(const std::vector<Vec3f> & positions, const Query_t & query,
+												BatchResult & result, unsigned int numThreads) const {
+	const std::size_t numQueries = positions.size();
+	std::vector<std::pair<uint32_t, uint32_t>> order; // (locality key, query index)
+	order.reserve(numQueries);
+	for (std::size_t q = 0; q < numQueries; ++q) {
+		order.emplace_back(getLocalityKey(positions[q]), static_cast<uint32_t>(q));
+	}
+	std::sort(order.begin(), order.end());
+
+	// every worker appends to its own buffer; the location of each query's results is remembered
+	struct QueryLocation {
+		uint32_t worker;
+		std::size_t begin;
+		std::size_t end;
+	};
+	std::vector<QueryLocation> locations(numQueries);
+	if (numThreads == 0) {
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	std::vector<std::vector<uint32_t>> buffers(numThreads);
+	static const std::size_t chunkSize = 64;
+	std::atomic<std::size_t> nextChunk(0);
+	std::mutex mutex;
+	std::exception_ptr error; //!< First exception thrown by a query; the remaining chunks are dropped.
+	std::atomic<bool> stopped(false);
+
+	auto worker = [&](uint32_t workerIndex) {
+		std::vector<uint32_t> & buffer = buffers[workerIndex];
+		traversal_stack_t activeCells;
+		try {
+			while (!stopped) {
+				const std::size_t chunkBegin = chunkSize * nextChunk.fetch_add(1);
+				if (chunkBegin >= numQueries) {
+					return;
+				}
+				const std::size_t chunkEnd = std::min(numQueries, chunkBegin + chunkSize);
+				for (std::size_t i = chunkBegin; i < chunkEnd; ++i) {
+					const uint32_t q = order[i].second;
+					locations[q].worker = workerIndex;
+					locations[q].begin = buffer.size();
+					query(q, activeCells, buffer);
+					locations[q].end = buffer.size();
+				}
+			}
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error) {
+				error = std::current_exception();
+			}
+			stopped = true;
+		}
+	};
+
+	//! Stops and joins the threads when leaving the scope, also if starting a thread fails.
+	struct ThreadGuard {
+		std::vector<std::thread> threads;
+		std::atomic<bool> & stopped;
+
+		~ThreadGuard() {
+			// all chunks are claimed when the calling thread's worker returns; claimed chunks are still finished
+			stopped = true;
+			for (auto & thread : threads) {
+				thread.join();
+			}
+		}
+	};
+	{
+		ThreadGuard guard{{}, stopped};
+		for (uint32_t i = 1; i < numThreads; ++i) {
+			guard.threads.emplace_back(worker, i);
+		}
+		worker(0);
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+
+	// gather the results in query order
+	result.offsets.resize(numQueries + 1);
+	result.offsets[0] = 0;
+	for (std::size_t q = 0; q < numQueries; ++q) {
+		result.offsets[q + 1] = result.offsets[q] + static_cast<uint32_t>(locations[q].end - locations[q].begin);
+	}
+	result.indices.resize(result.offsets.back());
+	for (std::size_t q = 0; q < numQueries; ++q) {
+		const auto & buffer = buffers[locations[q].worker];
+		std::copy(std::next(buffer.begin(), locations[q].begin), std::next(buffer.begin(), locations[q].end),
+				  std::next(result.indices.begin(), result.offsets[q]));
+	}
+}
+
+template <typename Point_t>
+inline void CompactPointOctree<Point_t>::collectPointIndicesWithinSpheres(const std::vector<Sphere_f> & spheres,
+																		   BatchResult & result,
+																		   unsigned int numThreads) const {
+	std::vector<Vec3f> positions;
+	positions.reserve(spheres.size());
+	for (const auto & sphere : spheres) {
+		positions.push_back(sphere.getCenter());
+	}
+	const Point_t * const firstPoint = points.data();
+	executeBatch(positions,
+				 [&](uint32_t q, traversal_stack_t & activeCells, std::vector<uint32_t> & out) {
+					 visitPointsWithinSphere(spheres[q],
+											 [&](const Point_t & p) {
+												 out.push_back(static_cast<uint32_t>(&p - firstPoint));
+												 return true;
+											 },
+											 activeCells);
+				 },
+				 result, numThreads);
+}
+
+template <typename Point_t>
+inline void CompactPointOctree<Point_t>::collectPointIndicesWithinBoxes(const std::vector<Box> & boxes,
+																		 BatchResult & result,
+																		 unsigned int numThreads) const {
+	std::vector<Vec3f> positions;
+	positions.reserve(boxes.size());
+	for (const auto & box : boxes) {
+		positions.push_back(box.getCenter());
+	}
+	const Point_t * const firstPoint = points.data();
+	executeBatch(positions,
+				 [&](uint32_t q, traversal_stack_t & activeCells, std::vector<uint32_t> & out) {
+					 visitPointsWithinBox(boxes[q],
+										  [&](const Point_t & p) {
+											  out.push_back(static_cast<uint32_t>(&p - firstPoint));
+											  return true;
+										  },
+										  activeCells);
+				 },
+				 result, numThreads);
+}
+
+template <typename Point_t>
+inline void CompactPointOctree<Point_t>::getClosestPointIndices(const std::vector<Vec3f> & positions, uint64_t count,
+																 BatchResult & result, unsigned int numThreads) const {
+	executeBatch(positions,
+				 [&](uint32_t q, traversal_stack_t &, std::vector<uint32_t> & out) {
+					 if (!getBox().contains(positions[q])) {
+						 return;
+					 }
+					 std::vector<std::pair<float, uint32_t>> closestPoints;
+					 findClosestPoints(positions[q], count, 0.0f, closestPoints);
+					 for (const auto & distanceIndexPair : closestPoints) {
+						 out.push_back(distanceIndexPair.second);
+					 }
+				 },
+				 result, numThreads);
+}
+}
+
+#endif /* GEOMETRY_COMPACTPOINTOCTREE_H */
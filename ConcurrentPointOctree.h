@@ -0,0 +1,476 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#ifndef GEOMETRY_CONCURRENTPOINTOCTREE_H
+#define GEOMETRY_CONCURRENTPOINTOCTREE_H
+
+#include "Box.h"
+#include "BoxHelper.h"
+#include "BoxIntersection.h"
+#include "Sphere.h"
+#include "Vec3.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Geometry {
+
+/**
+ * Variant of PointOctree for many concurrent readers and a single writer.
+ * Cells are immutable and shared between versions of the tree. A modification copies the cells on the path from the
+ * root to the modified leaf (copy-on-write) and publishes the new root atomically. Readers work on a Snapshot, which
+ * keeps the version it was taken from alive and never observes later modifications.
+ * Old versions are released by epoch-based reclamation: a snapshot registers the current epoch in a reader record,
+ * and the writer releases a replaced version during a later modification, once no snapshot of an earlier epoch
+ * exists. Readers neither take a lock nor modify reference counts shared with other readers; only the rare
+ * allocation of an additional reader record can wait inside the memory allocator.
+ *
+ * @note Snapshots must be destroyed before the tree.
+ * @note Leaves are split like the ones of PointOctree. After a removal, a subtree holding less than the maximum
+ * number of points of a leaf is merged into a single leaf.
+ */
+template <typename Point_t>
+class ConcurrentPointOctree {
+private:
+	struct Cell {
+		Box box; //!< Bounding box of octree cell.
+		std::vector<std::shared_ptr<const Cell>> children; //!< Child cells; empty for leaf cells.
+		std::vector<Point_t> points; //!< Points stored inside a leaf cell.
+		std::size_t count; //!< Number of points in the subtree.
+
+		explicit Cell(const Box & _box) : box(_box), children(), points(), count(0) {
+		}
+		bool isLeaf() const {
+			return children.empty();
+		}
+	};
+	using cell_ptr_t = std::shared_ptr<const Cell>;
+
+	//! Registration of the snapshots of one reader. Records are reused and released together with the tree.
+	struct ReaderRecord {
+		std::atomic<uint32_t> users; //!< Number of snapshots sharing the record; zero if the record is free.
+		std::atomic<uint64_t> epoch; //!< Epoch at the time the record was acquired.
+		ReaderRecord * next;
+		char padding[64]; //!< Keep the records of different readers on different cache lines.
+
+		ReaderRecord() : users(1), epoch(0), next(nullptr) {
+		}
+	};
+	//! Replaced version of the tree, which snapshots of epochs up to @a epoch may still use.
+	struct RetiredVersion {
+		cell_ptr_t root;
+		uint64_t epoch;
+	};
+
+	float minBoxSize; //!< Lower bound for side length of cell boundary.
+	uint32_t maxNumPoints; //!< Upper bound for number of points inside a leaf cell.
+	cell_ptr_t root; //!< Current version of the tree; only accessed by the writer.
+	std::atomic<const Cell *> publishedRoot; //!< Current version of the tree for the readers.
+	std::atomic<uint64_t> epoch; //!< Incremented by every modification.
+	mutable std::atomic<ReaderRecord *> readers; //!< Singly linked list of all reader records.
+	std::vector<RetiredVersion> retiredVersions; //!< Only accessed by the writer.
+	std::mutex writerMutex; //!< Serializes modifications.
+
+	//! Return a free reader record marked as used by one snapshot, or a newly allocated one.
+	ReaderRecord * acquireReaderRecord() const {
+		ReaderRecord * head = readers.load();
+		for (ReaderRecord * record = head; record != nullptr; record = record->next) {
+			uint32_t expected = 0;
+			if (record->users.load() == 0 && record->users.compare_exchange_strong(expected, 1)) {
+				return record;
+			}
+		}
+		ReaderRecord * record = new ReaderRecord;
+		record->next = head;
+		while (!readers.compare_exchange_weak(record->next, record)) {
+		}
+		return record;
+	}
+	//! Replace the current version by @p newRoot and release the versions no snapshot uses anymore.
+	void publish(cell_ptr_t newRoot) {
+		publishedRoot.store(newRoot.get());
+		retiredVersions.push_back({std::move(root), epoch.fetch_add(1)});
+		root = std::move(newRoot);
+
+		// A snapshot that loaded a replaced root has read the epoch before it was incremented.
+		uint64_t minEpoch = std::numeric_limits<uint64_t>::max();
+		for (ReaderRecord * record = readers.load(); record != nullptr; record = record->next) {
+			if (record->users.load() != 0) {
+				minEpoch = std::min(minEpoch, record->epoch.load());
+			}
+		}
+		retiredVersions.erase(std::remove_if(retiredVersions.begin(), retiredVersions.end(),
+											 [minEpoch](const RetiredVersion & version) {
+												 return version.epoch < minEpoch;
+											 }),
+							  retiredVersions.end());
+	}
+
+	//! Create a leaf for the given points, or a subtree if the points do not fit into a single leaf.
+	inline std::shared_ptr<Cell> createSubtree(const Box & box, std::vector<Point_t> && points) const;
+	//! Return a modified copy of the subtree containing the point, or nullptr if the point is outside.
+	inline cell_ptr_t insertInto(const Cell & cell, const Point_t & point) const;
+	//! Return a modified copy of the subtree without the points at the given position, or nullptr if nothing changed.
+	inline cell_ptr_t removeFrom(const Cell & cell, const Vec3f & position) const;
+	static void collectSubtree(const Cell & cell, std::vector<Point_t> & out) {
+		if (cell.isLeaf()) {
+			std::copy(cell.points.begin(), cell.points.end(), std::back_inserter(out));
+		} else {
+			for (const auto & child : cell.children) {
+				collectSubtree(*child, out);
+			}
+		}
+	}
+
+public:
+	using point_t = Point_t;
+
+	/**
+	 * Immutable version of the tree. Queries on a snapshot are consistent and unaffected by concurrent
+	 * modifications of the tree. Copying a snapshot is cheap; the copies share the reader record.
+	 */
+	class Snapshot {
+	private:
+		friend class ConcurrentPointOctree;
+
+		const Cell * root;
+		ReaderRecord * record;
+
+		Snapshot(const Cell * _root, ReaderRecord * _record) : root(_root), record(_record) {
+		}
+
+		template <typename Visitor_t>
+		static bool visitSubtree(const Cell * subtree, Visitor_t & visitor, std::vector<const Cell *> & activeCells) {
+			const std::size_t base = activeCells.size();
+			activeCells.push_back(subtree);
+			while (activeCells.size() > base) {
+				const Cell * cell = activeCells.back();
+				activeCells.pop_back();
+				for (const auto & child : cell->children) {
+					activeCells.push_back(child.get());
+				}
+				for (const auto & p : cell->points) {
+					if (!visitor(p)) {
+						activeCells.resize(base);
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+	public:
+		Snapshot(const Snapshot & other) : root(other.root), record(other.record) {
+			record->users.fetch_add(1);
+		}
+		Snapshot & operator=(const Snapshot & other) {
+			other.record->users.fetch_add(1);
+			record->users.fetch_sub(1);
+			root = other.root;
+			record = other.record;
+			return *this;
+		}
+		~Snapshot() {
+			record->users.fetch_sub(1);
+		}
+
+		const Box & getBox() const {
+			return root->box;
+		}
+		//! Return the number of points in the snapshot.
+		std::size_t size() const {
+			return root->count;
+		}
+		bool empty() const {
+			return root->count == 0;
+		}
+
+		/**
+		 * Call the visitor for all points. The visitor returns @c false to stop the traversal.
+		 * @see PointOctree::visitPoints
+		 */
+		template <typename Visitor_t>
+		bool visitPoints(Visitor_t && visitor) const {
+			std::vector<const Cell *> activeCells;
+			return visitSubtree(root, visitor, activeCells);
+		}
+
+		/**
+		 * Call the visitor for all points within the given box. The visitor returns @c false to stop the traversal.
+		 * @see PointOctree::visitPointsWithinBox
+		 */
+		template <typename Visitor_t>
+		bool visitPointsWithinBox(const Box & queryBox, Visitor_t && visitor) const {
+			std::vector<const Cell *> activeCells;
+			activeCells.push_back(root);
+			while (!activeCells.empty()) {
+				const Cell * cell = activeCells.back();
+				activeCells.pop_back();
+				if (!Intersection::isBoxTouchingBox(cell->box, queryBox)) {
+					continue;
+				} else if (queryBox.contains(cell->box)) {
+					if (!visitSubtree(cell, visitor, activeCells)) {
+						return false;
+					}
+				} else if (!cell->isLeaf()) {
+					for (const auto & child : cell->children) {
+						activeCells.push_back(child.get());
+					}
+				} else {
+					for (const auto & p : cell->points) {
+						if (queryBox.contains(p.getPosition()) && !visitor(p)) {
+							return false;
+						}
+					}
+				}
+			}
+			return true;
+		}
+
+		/**
+		 * Call the visitor for all points within the sphere. The visitor returns @c false to stop the traversal.
+		 * @see PointOctree::visitPointsWithinSphere
+		 */
+		template <typename Visitor_t>
+		bool visitPointsWithinSphere(const Sphere_f & sphere, Visitor_t && visitor) const {
+			const float radiusSquared = sphere.getRadius() * sphere.getRadius();
+			std::vector<const Cell *> activeCells;
+			activeCells.push_back(root);
+			while (!activeCells.empty()) {
+				const Cell * cell = activeCells.back();
+				activeCells.pop_back();
+				if (cell->box.getDistanceSquared(sphere.getCenter()) > radiusSquared) {
+					continue;
+				} else if (!cell->isLeaf()) {
+					for (const auto & child : cell->children) {
+						activeCells.push_back(child.get());
+					}
+				} else {
+					for (const auto & p : cell->points) {
+						if (!sphere.isOutside(p.getPosition()) && !visitor(p)) {
+							return false;
+						}
+					}
+				}
+			}
+			return true;
+		}
+
+		//! Return all points.
+		void collectPoints(std::deque<Point_t> & out) const {
+			visitPoints([&out](const Point_t & p) {
+				out.push_back(p);
+				return true;
+			});
+		}
+		//! Return all points where the location is within the given box.
+		void collectPointsWithinBox(const Box & box, std::deque<Point_t> & out) const {
+			visitPointsWithinBox(box, [&out](const Point_t & p) {
+				out.push_back(p);
+				return true;
+			});
+		}
+		//! Return all points where the location is within the sphere.
+		void collectPointsWithinSphere(const Sphere_f & sphere, std::deque<Point_t> & out) const {
+			visitPointsWithinSphere(sphere, [&out](const Point_t & p) {
+				out.push_back(p);
+				return true;
+			});
+		}
+	};
+
+	/**
+	 * Create a new octree for points within the given bounds.
+	 *
+	 * @param boundingBox Bounding box for all points to store.
+	 * @param minimumBoxSize Minimum side length of leaf cells. If this is reached, the leaf will not be split anymore.
+	 * @param maximumPoints Maximum number of points in leaf cells. If this is reached, a leaf will be split.
+	 */
+	ConcurrentPointOctree(const Box & boundingBox, float minimumBoxSize, uint32_t maximumPoints)
+			: minBoxSize(minimumBoxSize),
+			  maxNumPoints(maximumPoints),
+			  root(std::make_shared<Cell>(boundingBox)),
+			  publishedRoot(root.get()),
+			  epoch(1),
+			  readers(nullptr) {
+	}
+	~ConcurrentPointOctree() {
+		ReaderRecord * record = readers.load();
+		while (record != nullptr) {
+			ReaderRecord * next = record->next;
+			delete record;
+			record = next;
+		}
+	}
+
+	float getMinBoxSize() const {
+		return minBoxSize;
+	}
+	uint32_t getMaxNumPoints() const {
+		return maxNumPoints;
+	}
+
+	//! Return the current version of the tree. Can be called from any thread.
+	Snapshot getSnapshot() const {
+		ReaderRecord * record = acquireReaderRecord();
+		// the epoch is registered before the root is loaded, so that the writer keeps the loaded version
+		record->epoch.store(epoch.load());
+		return Snapshot(publishedRoot.load(), record);
+	}
+
+	/**
+	 * Insert the point into the octree. The modification is visible to snapshots taken afterwards.
+	 *
+	 * @param point Data item containing the position.
+	 * @return @c false if the point is outside of the octree.
+	 */
+	bool insert(const Point_t & point) {
+		std::lock_guard<std::mutex> lock(writerMutex);
+		cell_ptr_t newRoot = insertInto(*root, point);
+		if (!newRoot) {
+			return false;
+		}
+		publish(std::move(newRoot));
+		return true;
+	}
+
+	/**
+	 * Remove all points located at the position of the given point.
+	 * The modification is visible to snapshots taken afterwards.
+	 *
+	 * @param point Data item containing the position.
+	 * @return @c true if at least one point has been removed.
+	 */
+	bool remove(const Point_t & point) {
+		std::lock_guard<std::mutex> lock(writerMutex);
+		cell_ptr_t newRoot = removeFrom(*root, point.getPosition());
+		if (!newRoot) {
+			return false;
+		}
+		publish(std::move(newRoot));
+		return true;
+	}
+
+	//! Delete all points.
+	void clear() {
+		std::lock_guard<std::mutex> lock(writerMutex);
+		publish(std::make_shared<Cell>(root->box));
+	}
+};
+
+template <typename Point_t>
+inline std::shared_ptr<typename ConcurrentPointOctree<Point_t>::Cell>
+ConcurrentPointOctree<Point_t>::createSubtree(const Box & box, std::vector<Point_t> && points) const {
+	auto cell = std::make_shared<Cell>(box);
+	cell->count = points.size();
+	if (points.size() <= maxNumPoints || box.getExtentMax() < minBoxSize * 2.0) {
+		cell->points = std::move(points);
+		return cell;
+	}
+	// distribute points to the first child containing them, like PointOctree::insert()
+	const auto newBoxes = Helper::splitBoxCubeLike(box);
+	std::vector<std::vector<Point_t>> childPoints(newBoxes.size());
+	for (const auto & p : points) {
+		for (std::size_t i = 0; i < newBoxes.size(); ++i) {
+			if (newBoxes[i].contains(p.getPosition())) {
+				childPoints[i].push_back(p);
+				break;
+			}
+		}
+	}
+	cell->count = 0;
+	cell->children.reserve(newBoxes.size());
+	for (std::size_t i = 0; i < newBoxes.size(); ++i) {
+		cell->children.push_back(createSubtree(newBoxes[i], std::move(childPoints[i])));
+		cell->count += cell->children.back()->count;
+	}
+	return cell;
+}
+
+template <typename Point_t>
+inline typename ConcurrentPointOctree<Point_t>::cell_ptr_t
+ConcurrentPointOctree<Point_t>::insertInto(const Cell & cell, const Point_t & point) const {
+	if (!cell.box.contains(point.getPosition())) {
+		return nullptr;
+	} else if (cell.isLeaf()) {
+		std::vector<Point_t> newPoints;
+		newPoints.reserve(cell.points.size() + 1);
+		std::copy(cell.points.begin(), cell.points.end(), std::back_inserter(newPoints));
+		newPoints.push_back(point);
+		return createSubtree(cell.box, std::move(newPoints));
+	}
+	for (std::size_t i = 0; i < cell.children.size(); ++i) {
+		cell_ptr_t newChild = insertInto(*cell.children[i], point);
+		if (newChild) {
+			// copy this cell; unchanged children are shared with the old version
+			auto newCell = std::make_shared<Cell>(cell);
+			newCell->children[i] = std::move(newChild);
+			++newCell->count;
+			return newCell;
+		}
+	}
+	return nullptr;
+}
+
+template <typename Point_t>
+inline typename ConcurrentPointOctree<Point_t>::cell_ptr_t
+ConcurrentPointOctree<Point_t>::removeFrom(const Cell & cell, const Vec3f & position) const {
+	if (!cell.box.contains(position)) {
+		return nullptr;
+	} else if (cell.isLeaf()) {
+		auto newCell = std::make_shared<Cell>(cell.box);
+		for (const auto & p : cell.points) {
+			if (!(p.getPosition() == position)) {
+				newCell->points.push_back(p);
+			}
+		}
+		if (newCell->points.size() == cell.points.size()) {
+			return nullptr;
+		}
+		newCell->count = newCell->points.size();
+		return newCell;
+	}
+	for (std::size_t i = 0; i < cell.children.size(); ++i) {
+		if (!cell.children[i]->box.contains(position)) {
+			continue;
+		}
+		cell_ptr_t newChild = removeFrom(*cell.children[i], position);
+		if (!newChild) {
+			return nullptr;
+		}
+		const std::size_t newCount = cell.count - (cell.children[i]->count - newChild->count);
+		if (newCount < maxNumPoints) {
+			// merge the subtree into a single leaf
+			auto newCell = std::make_shared<Cell>(cell.box);
+			for (std::size_t j = 0; j < cell.children.size(); ++j) {
+				collectSubtree(j == i ? *newChild : *cell.children[j], newCell->points);
+			}
+			newCell->count = newCell->points.size();
+			return newCell;
+		}
+		auto newCell = std::make_shared<Cell>(cell);
+		newCell->children[i] = std::move(newChild);
+		newCell->count = newCount;
+		return newCell;
+	}
+	return nullptr;
+}
+}
+
+#endif /* GEOMETRY_CONCURRENTPOINTOCTREE_H */
@@ -157,6 +157,27 @@ Frustum::intersection_t Frustum::isBoxInFrustum(const Box & b) const {
 	}
 }
 
+Frustum::intersection_t Frustum::isBoxInFrustum(const Box & b, uint8_t & planeMask) const {
+	uint8_t intersectingPlanes = planeMask;
+	for (uint_fast8_t plane = 0; plane < 6; ++plane) {
+		const uint8_t planeBit = static_cast<uint8_t>(1u << plane);
+		if ((intersectingPlanes & planeBit) == 0) {
+			continue;
+		}
+		const Vec3 nVec = b.getCorner(negCorner[plane]);
+		if (planes[plane].planeTest(nVec) > 0) {
+			return intersection_t::OUTSIDE;
+		}
+
+		const Vec3 pVec = b.getCorner(posCorner[plane]);
+		if (planes[plane].planeTest(pVec) <= 0) {
+			intersectingPlanes &= static_cast<uint8_t>(~planeBit);
+		}
+	}
+	planeMask = intersectingPlanes;
+	return planeMask == 0 ? intersection_t::INSIDE : intersection_t::INTERSECT;
+}
+
 bool Frustum::operator==(const Frustum & other) const {
 	return projectionMatrix == other.projectionMatrix;
 }
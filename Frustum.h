@@ -16,6 +16,7 @@
 #include "SRT.h"
 #include "Vec3.h"
 #include "Plane.h"
+#include <cstdint>
 #include <stdexcept>
 
 namespace Geometry {
@@ -80,6 +81,15 @@ public:
 	}
 
 	GEOMETRYAPI intersection_t isBoxInFrustum(const Box & b) const;
+	/**
+	 * Hierarchical variant of isBoxInFrustum(const Box &) for nested boxes.
+	 * Only the planes with a set bit (1 << side_t) in @p planeMask are tested. The bits of the planes the box is
+	 * completely inside of are cleared, so the mask can be passed on to the boxes contained in @p b.
+	 *
+	 * @param planeMask Planes to test; use @c 0x3f for all planes. Not changed if the box is outside.
+	 * @return INSIDE if the box is inside all tested planes.
+	 */
+	GEOMETRYAPI intersection_t isBoxInFrustum(const Box & b, uint8_t & planeMask) const;
 	inline bool pointInFrustum(const Vec3 & p) const;
 	inline Vec3 operator[](corner_t nr) const;
 	GEOMETRYAPI bool operator==(const Frustum & other) const;
@@ -0,0 +1,119 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include "MappedFile.h"
+#include <cstdio>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Geometry {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string & path)
+		: address(nullptr), length(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr) {
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+							 FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("MappedFile: cannot open \"" + path + "\"");
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize)) {
+		CloseHandle(fileHandle);
+		throw std::runtime_error("MappedFile: cannot determine the size of \"" + path + "\"");
+	}
+	length = static_cast<std::size_t>(fileSize.QuadPart);
+	if (length == 0) {
+		return;
+	}
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle != nullptr) {
+		address = static_cast<const uint8_t *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (address == nullptr) {
+		if (mappingHandle != nullptr) {
+			CloseHandle(mappingHandle);
+		}
+		CloseHandle(fileHandle);
+		throw std::runtime_error("MappedFile: cannot map \"" + path + "\"");
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (address != nullptr) {
+		UnmapViewOfFile(address);
+	}
+	if (mappingHandle != nullptr) {
+		CloseHandle(mappingHandle);
+	}
+	CloseHandle(fileHandle);
+}
+
+void MappedFile::replaceFile(const std::string & source, const std::string & target) {
+	if (!MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		throw std::runtime_error("MappedFile: cannot replace \"" + target + "\"");
+	}
+}
+
+#else
+
+MappedFile::MappedFile(const std::string & path) : address(nullptr), length(0) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("MappedFile: cannot open \"" + path + "\"");
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0) {
+		close(fd);
+		throw std::runtime_error("MappedFile: cannot determine the size of \"" + path + "\"");
+	}
+	length = static_cast<std::size_t>(status.st_size);
+	if (length > 0) {
+		void * mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+		if (mapping == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("MappedFile: cannot map \"" + path + "\"");
+		}
+		address = static_cast<const uint8_t *>(mapping);
+	}
+	// the mapping stays valid after closing the descriptor
+	close(fd);
+}
+
+MappedFile::~MappedFile() {
+	if (address != nullptr) {
+		munmap(const_cast<uint8_t *>(address), length);
+	}
+}
+
+void MappedFile::replaceFile(const std::string & source, const std::string & target) {
+	// rename() replaces the directory entry; processes mapping the old file keep its pages
+	if (std::rename(source.c_str(), target.c_str()) != 0) {
+		throw std::runtime_error("MappedFile: cannot replace \"" + target + "\"");
+	}
+}
+
+#endif
+}
@@ -0,0 +1,67 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#ifndef GEOMETRY_MAPPEDFILE_H
+#define GEOMETRY_MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Geometry {
+
+/**
+ * Read-only memory mapping of a whole file.
+ * The pages are loaded lazily on first access and are shared with all other processes mapping the same file.
+ */
+class MappedFile {
+public:
+	/**
+	 * Map the file into memory.
+	 *
+	 * @param path Path of the file to map.
+	 * @throw std::runtime_error if the file cannot be opened or mapped.
+	 */
+	GEOMETRYAPI explicit MappedFile(const std::string & path);
+	GEOMETRYAPI ~MappedFile();
+
+	/**
+	 * Replace the file @p target by the file @p source in one step.
+	 * Mappings of the old @p target stay valid, because its contents are not modified. On Windows, this fails as long
+	 * as @p target is mapped.
+	 *
+	 * @throw std::runtime_error if the file cannot be replaced.
+	 */
+	GEOMETRYAPI static void replaceFile(const std::string & source, const std::string & target);
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	//! Return the first byte of the file, or nullptr for an empty file.
+	const uint8_t * data() const {
+		return address;
+	}
+	//! Return the size of the file in bytes.
+	std::size_t size() const {
+		return length;
+	}
+
+private:
+	const uint8_t * address;
+	std::size_t length;
+#ifdef _WIN32
+	void * fileHandle;
+	void * mappingHandle;
+#endif
+};
+}
+
+#endif /* GEOMETRY_MAPPEDFILE_H */
@@ -0,0 +1,147 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#ifndef GEOMETRY_MORTON_H
+#define GEOMETRY_MORTON_H
+
+#include <cstdint>
+
+#if defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__))
+#include <immintrin.h>
+#define GEOMETRY_MORTON_BMI2
+#if defined(__x86_64__) || defined(_M_X64)
+#define GEOMETRY_MORTON_BMI2_64
+#endif
+#endif
+
+namespace Geometry {
+
+/**
+ * Three-dimensional Morton codes (Z-order curve).
+ * The bits of the coordinates are interleaved such that bit @c i of x is stored in bit <tt>3*i</tt>, bit @c i of y in
+ * bit <tt>3*i+1</tt>, and bit @c i of z in bit <tt>3*i+2</tt> of the code.
+ * If the target supports BMI2, the parallel bit deposit and extract instructions are used; otherwise the bits are
+ * spread with magic-number shifts and masks.
+ */
+namespace Morton {
+
+//! Number of bits per coordinate that fit into a 32 bit code.
+static const uint32_t BITS_32 = 10;
+//! Number of bits per coordinate that fit into a 64 bit code.
+static const uint32_t BITS_64 = 21;
+
+namespace _Internal {
+static const uint32_t MASK_X_32 = 0x09249249u;
+static const uint64_t MASK_X_64 = 0x1249249249249249ull;
+
+//! Insert two zero bits after each of the lower ten bits.
+inline uint32_t spreadBits32(uint32_t value) {
+	value &= 0x000003ffu;
+	value = (value | (value << 16)) & 0x030000ffu;
+	value = (value | (value << 8)) & 0x0300f00fu;
+	value = (value | (value << 4)) & 0x030c30c3u;
+	value = (value | (value << 2)) & 0x09249249u;
+	return value;
+}
+
+//! Inverse of spreadBits32(): keep every third bit and compact them.
+inline uint32_t compactBits32(uint32_t value) {
+	value &= 0x09249249u;
+	value = (value | (value >> 2)) & 0x030c30c3u;
+	value = (value | (value >> 4)) & 0x0300f00fu;
+	value = (value | (value >> 8)) & 0x030000ffu;
+	value = (value | (value >> 16)) & 0x000003ffu;
+	return value;
+}
+
+//! Insert two zero bits after each of the lower 21 bits.
+inline uint64_t spreadBits64(uint64_t value) {
+	value &= 0x00000000001fffffull;
+	value = (value | (value << 32)) & 0x001f00000000ffffull;
+	value = (value | (value << 16)) & 0x001f0000ff0000ffull;
+	value = (value | (value << 8)) & 0x100f00f00f00f00full;
+	value = (value | (value << 4)) & 0x10c30c30c30c30c3ull;
+	value = (value | (value << 2)) & 0x1249249249249249ull;
+	return value;
+}
+
+//! Inverse of spreadBits64(): keep every third bit and compact them.
+inline uint64_t compactBits64(uint64_t value) {
+	value &= 0x1249249249249249ull;
+	value = (value | (value >> 2)) & 0x10c30c30c30c30c3ull;
+	value = (value | (value >> 4)) & 0x100f00f00f00f00full;
+	value = (value | (value >> 8)) & 0x001f0000ff0000ffull;
+	value = (value | (value >> 16)) & 0x001f00000000ffffull;
+	value = (value | (value >> 32)) & 0x00000000001fffffull;
+	return value;
+}
+}
+
+/**
+ * Interleave the lower ten bits of the three coordinates.
+ *
+ * @return Code in the lower 30 bits.
+ */
+inline uint32_t encode32(uint32_t x, uint32_t y, uint32_t z) {
+#if defined(GEOMETRY_MORTON_BMI2)
+	using namespace _Internal;
+	return _pdep_u32(x, MASK_X_32) | _pdep_u32(y, MASK_X_32 << 1) | _pdep_u32(z, MASK_X_32 << 2);
+#else
+	using namespace _Internal;
+	return spreadBits32(x) | (spreadBits32(y) << 1) | (spreadBits32(z) << 2);
+#endif
+}
+
+//! Inverse of encode32().
+inline void decode32(uint32_t code, uint32_t & x, uint32_t & y, uint32_t & z) {
+	using namespace _Internal;
+#if defined(GEOMETRY_MORTON_BMI2)
+	x = _pext_u32(code, MASK_X_32);
+	y = _pext_u32(code, MASK_X_32 << 1);
+	z = _pext_u32(code, MASK_X_32 << 2);
+#else
+	x = compactBits32(code);
+	y = compactBits32(code >> 1);
+	z = compactBits32(code >> 2);
+#endif
+}
+
+/**
+ * Interleave the lower 21 bits of the three coordinates.
+ *
+ * @return Code in the lower 63 bits.
+ */
+inline uint64_t encode64(uint32_t x, uint32_t y, uint32_t z) {
+	using namespace _Internal;
+#if defined(GEOMETRY_MORTON_BMI2_64)
+	return _pdep_u64(x, MASK_X_64) | _pdep_u64(y, MASK_X_64 << 1) | _pdep_u64(z, MASK_X_64 << 2);
+#else
+	return spreadBits64(x) | (spreadBits64(y) << 1) | (spreadBits64(z) << 2);
+#endif
+}
+
+//! Inverse of encode64().
+inline void decode64(uint64_t code, uint32_t & x, uint32_t & y, uint32_t & z) {
+	using namespace _Internal;
+#if defined(GEOMETRY_MORTON_BMI2_64)
+	x = static_cast<uint32_t>(_pext_u64(code, MASK_X_64));
+	y = static_cast<uint32_t>(_pext_u64(code, MASK_X_64 << 1));
+	z = static_cast<uint32_t>(_pext_u64(code, MASK_X_64 << 2));
+#else
+	x = static_cast<uint32_t>(compactBits64(code));
+	y = static_cast<uint32_t>(compactBits64(code >> 1));
+	z = static_cast<uint32_t>(compactBits64(code >> 2));
+#endif
+}
+}
+}
+
+#endif /* GEOMETRY_MORTON_H */
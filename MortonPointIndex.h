@@ -0,0 +1,328 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#ifndef GEOMETRY_MORTONPOINTINDEX_H
+#define GEOMETRY_MORTONPOINTINDEX_H
+
+#include "Box.h"
+#include "Morton.h"
+#include "Vec3.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace Geometry {
+
+/**
+ * Static point index storing the points in one array sorted along a Z-order curve.
+ * The bounding box is divided into a grid of 2^21 cells per axis and every point is assigned the 64 bit Morton code of
+ * its grid cell. The points are sorted by their codes with a radix sort, so that points close to each other in space
+ * are mostly close to each other in memory. A box query is decomposed into a small number of code intervals that are
+ * located by binary search.
+ * Compared to PointOctree, the index needs no nodes at all and only one allocation per array, but it cannot be
+ * modified after construction.
+ *
+ * @note Points outside of the bounding box are assigned to the nearest grid cell at the border. They are found by
+ * all queries, but the queries are less efficient for them.
+ * @note The number of points is limited to 2^32-1.
+ */
+template <typename Point_t>
+class MortonPointIndex {
+public:
+	using point_t = Point_t;
+
+	//! Number of grid cells along each axis.
+	static const uint32_t GRID_SIZE = 1u << Morton::BITS_64;
+
+	//! Closed interval of Morton codes.
+	struct KeyInterval {
+		uint64_t first; //!< Smallest code of the interval.
+		uint64_t last; //!< Largest code of the interval.
+		bool contained; //!< @c true if all points with a code inside the interval are inside the query box.
+
+		KeyInterval(uint64_t _first, uint64_t _last, bool _contained)
+				: first(_first), last(_last), contained(_contained) {
+		}
+	};
+
+private:
+	Box bounds;
+	std::vector<Point_t> points; //!< All points sorted by code.
+	std::vector<uint64_t> codes; //!< Morton code of every point.
+
+	uint32_t quantize(float value, float min, float extent) const {
+		const float relative = extent > 0.0f ? (value - min) / extent * static_cast<float>(GRID_SIZE) : 0.0f;
+		if (!(relative > 0.0f)) {
+			return 0;
+		}
+		return relative >= static_cast<float>(GRID_SIZE - 1) ? GRID_SIZE - 1 : static_cast<uint32_t>(relative);
+	}
+
+	//! Sort the codes stably with a least significant digit radix sort and return the permutation in @p order.
+	static inline void radixSort(std::vector<uint64_t> & keys, std::vector<uint32_t> & order);
+
+	//! Result of classifyCell().
+	enum cellClass_t { DISJOINT, PARTIAL, CONTAINED };
+
+	/**
+	 * Classify the grid cells with codes in [@p code, @p code + 8^@p level) against the query ranges.
+	 * @p lower and @p upper are the grid coordinates touched by the query box; @p innerLower and @p innerUpper are the
+	 * grid coordinates completely inside of the query box.
+	 */
+	static cellClass_t classifyCell(uint64_t code, uint32_t level, const int64_t lower[3], const int64_t upper[3],
+									const int64_t innerLower[3], const int64_t innerUpper[3]) {
+		uint32_t cellMin[3];
+		Morton::decode64(code, cellMin[0], cellMin[1], cellMin[2]);
+		bool contained = true;
+		for (uint_fast8_t axis = 0; axis < 3; ++axis) {
+			const int64_t min = cellMin[axis];
+			const int64_t max = min + (int64_t(1) << level) - 1;
+			if (max < lower[axis] || min > upper[axis]) {
+				return DISJOINT;
+			}
+			contained = contained && min >= innerLower[axis] && max <= innerUpper[axis];
+		}
+		return contained ? CONTAINED : PARTIAL;
+	}
+
+	template <typename Visitor_t>
+	bool visitInterval(const KeyInterval & interval, std::size_t & index, const Box & box, Visitor_t & visitor) const {
+		index = static_cast<std::size_t>(std::lower_bound(codes.begin() + index, codes.end(), interval.first)
+										 - codes.begin());
+		for (; index < codes.size() && codes[index] <= interval.last; ++index) {
+			const Point_t & point = points[index];
+			if ((interval.contained || box.contains(point.getPosition())) && !visitor(point)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+public:
+	/**
+	 * Create an index of the given points.
+	 *
+	 * @param _bounds Bounding box used for the quantization of the point positions.
+	 * @param first Iterator to the first point.
+	 * @param last Iterator behind the last point.
+	 * @throw std::length_error if there are more than 2^32-1 points.
+	 */
+	template <typename InputIterator>
+	MortonPointIndex(const Box & _bounds, InputIterator first, InputIterator last) : bounds(_bounds) {
+		const std::vector<Point_t> unsorted(first, last);
+		if (static_cast<uint64_t>(unsorted.size()) > static_cast<uint64_t>(UINT32_MAX)) {
+			throw std::length_error("MortonPointIndex: too many points");
+		}
+		codes.reserve(unsorted.size());
+		for (const auto & point : unsorted) {
+			codes.push_back(getCode(point.getPosition()));
+		}
+		std::vector<uint32_t> order;
+		radixSort(codes, order);
+		points.reserve(unsorted.size());
+		for (const auto index : order) {
+			points.push_back(unsorted[index]);
+		}
+	}
+
+	const Box & getBox() const {
+		return bounds;
+	}
+	std::size_t size() const {
+		return points.size();
+	}
+	bool empty() const {
+		return points.empty();
+	}
+	//! Return all points ordered by their codes.
+	const std::vector<Point_t> & getPoints() const {
+		return points;
+	}
+	//! Return the code of every point in the same order as getPoints().
+	const std::vector<uint64_t> & getCodes() const {
+		return codes;
+	}
+
+	//! Return the Morton code of the grid cell containing the given position.
+	uint64_t getCode(const Vec3f & pos) const {
+		return Morton::encode64(quantize(pos.x(), bounds.getMinX(), bounds.getExtentX()),
+								quantize(pos.y(), bounds.getMinY(), bounds.getExtentY()),
+								quantize(pos.z(), bounds.getMinZ(), bounds.getExtentZ()));
+	}
+
+	/**
+	 * Decompose a query box into ascending, disjoint intervals of Morton codes covering all grid cells touched by the
+	 * box. The grid is refined level by level as long as the number of intervals stays below the given limit, so a
+	 * smaller limit produces coarser intervals containing more points outside of the box.
+	 *
+	 * @param box Query box.
+	 * @param[out] intervals Resulting intervals; the previous content is removed.
+	 * @param maxIntervals Upper bound for the number of intervals that stops the refinement.
+	 */
+	inline void getKeyIntervals(const Box & box, std::vector<KeyInterval> & intervals,
+								std::size_t maxIntervals = 64) const;
+
+	/**
+	 * Return all points where the location is within the given box.
+	 *
+	 * @param box
+	 * @param out Points that fulfill the condition are added to this container.
+	 */
+	void collectPointsWithinBox(const Box & box, std::deque<Point_t> & out) const {
+		visitPointsWithinBox(box, [&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+
+	/**
+	 * @name Visitor queries
+	 * The visitor is called with a const reference to every point fulfilling the condition and returns @c false to
+	 * stop the traversal. The functions return @c false if the traversal has been stopped by the visitor.
+	 * Passing an interval array that is reused between queries avoids all heap allocations.
+	 * @see PointOctree::visitPoints
+	 */
+	//@{
+	template <typename Visitor_t>
+	bool visitPoints(Visitor_t && visitor) const {
+		for (const auto & point : points) {
+			if (!visitor(point)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template <typename Visitor_t>
+	bool visitPointsWithinBox(const Box & box, Visitor_t && visitor, std::vector<KeyInterval> & intervals) const {
+		getKeyIntervals(box, intervals);
+		std::size_t index = 0;
+		for (const auto & interval : intervals) {
+			if (!visitInterval(interval, index, box, visitor)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	template <typename Visitor_t>
+	bool visitPointsWithinBox(const Box & box, Visitor_t && visitor) const {
+		std::vector<KeyInterval> intervals;
+		return visitPointsWithinBox(box, std::forward<Visitor_t>(visitor), intervals);
+	}
+	//@}
+};
+
+template <typename Point_t>
+const uint32_t MortonPointIndex<Point_t>::GRID_SIZE;
+
+template <typename Point_t>
+inline void MortonPointIndex<Point_t>::radixSort(std::vector<uint64_t> & keys, std::vector<uint32_t> & order) {
+	const std::size_t count = keys.size();
+	order.resize(count);
+	for (std::size_t i = 0; i < count; ++i) {
+		order[i] = static_cast<uint32_t>(i);
+	}
+	std::vector<uint64_t> keyBuffer(count);
+	std::vector<uint32_t> orderBuffer(count);
+	std::size_t histogram[256];
+	for (uint32_t shift = 0; shift < 3 * Morton::BITS_64; shift += 8) {
+		std::fill(histogram, histogram + 256, 0);
+		for (const auto key : keys) {
+			++histogram[(key >> shift) & 0xff];
+		}
+		// skip the digit if all keys share it
+		if (count == 0 || histogram[(keys.front() >> shift) & 0xff] == count) {
+			continue;
+		}
+		std::size_t offset = 0;
+		for (auto & bucket : histogram) {
+			const std::size_t bucketSize = bucket;
+			bucket = offset;
+			offset += bucketSize;
+		}
+		for (std::size_t i = 0; i < count; ++i) {
+			const std::size_t target = histogram[(keys[i] >> shift) & 0xff]++;
+			keyBuffer[target] = keys[i];
+			orderBuffer[target] = order[i];
+		}
+		keys.swap(keyBuffer);
+		order.swap(orderBuffer);
+	}
+}
+
+template <typename Point_t>
+inline void MortonPointIndex<Point_t>::getKeyIntervals(const Box & box, std::vector<KeyInterval> & intervals,
+													   std::size_t maxIntervals) const {
+	intervals.clear();
+	if (box.getMinX() > box.getMaxX() || box.getMinY() > box.getMaxY() || box.getMinZ() > box.getMaxZ()) {
+		return;
+	}
+	int64_t lower[3], upper[3], innerLower[3], innerUpper[3];
+	for (uint_fast8_t axis = 0; axis < 3; ++axis) {
+		const auto a = static_cast<dimension_t>(axis);
+		lower[axis] = quantize(box.getMin(a), bounds.getMin(a), bounds.getExtent(a));
+		upper[axis] = quantize(box.getMax(a), bounds.getMin(a), bounds.getExtent(a));
+		// the border cells may contain points outside of the box
+		innerLower[axis] = lower[axis] + 1;
+		innerUpper[axis] = upper[axis] - 1;
+	}
+
+	struct Cell {
+		uint64_t code;
+		uint32_t level;
+		cellClass_t type;
+	};
+	std::vector<Cell> cells;
+	std::vector<Cell> refinedCells;
+	cells.push_back({0, Morton::BITS_64, PARTIAL});
+	while (true) {
+		refinedCells.clear();
+		bool refined = false;
+		for (const auto & cell : cells) {
+			if (cell.type != PARTIAL || cell.level == 0) {
+				refinedCells.push_back(cell);
+				continue;
+			}
+			refined = true;
+			const uint32_t childLevel = cell.level - 1;
+			for (uint64_t child = 0; child < 8; ++child) {
+				const uint64_t childCode = cell.code + (child << (3 * childLevel));
+				const cellClass_t type = classifyCell(childCode, childLevel, lower, upper, innerLower, innerUpper);
+				if (type != DISJOINT) {
+					refinedCells.push_back({childCode, childLevel, type});
+				}
+			}
+		}
+		if (!refined || refinedCells.size() > maxIntervals) {
+			break;
+		}
+		cells.swap(refinedCells);
+	}
+
+	// cells are ordered by their codes; merge adjacent cells of the same type
+	for (const auto & cell : cells) {
+		const uint64_t first = cell.code;
+		const uint64_t last = cell.code + (uint64_t(1) << (3 * cell.level)) - 1;
+		const bool contained = cell.type == CONTAINED;
+		if (!intervals.empty() && intervals.back().last + 1 == first && intervals.back().contained == contained) {
+			intervals.back().last = last;
+		} else {
+			intervals.emplace_back(first, last, contained);
+		}
+	}
+}
+}
+
+#endif /* GEOMETRY_MORTONPOINTINDEX_H */
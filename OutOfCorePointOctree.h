@@ -0,0 +1,605 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#ifndef GEOMETRY_OUTOFCOREPOINTOCTREE_H
+#define GEOMETRY_OUTOFCOREPOINTOCTREE_H
+
+#include "Box.h"
+#include "BoxHelper.h"
+#include "BoxIntersection.h"
+#include "CompactPointOctree.h"
+#include "MappedFile.h"
+#include "PointOctree.h"
+#include "Sphere.h"
+#include "Vec3.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Geometry {
+
+/**
+ * Octree for point sets that do not fit into main memory.
+ * The upper levels of the tree form a small index that is kept in memory. Every leaf of the index refers to a chunk:
+ * a subtree that is stored in its own file in the format of CompactPointOctree::saveToFile(). Queries load the chunks
+ * they touch on demand. Loaded chunks are kept in a least-recently-used cache whose size is limited by a memory
+ * budget.
+ *
+ * A tree is created by a Builder, which partitions the streamed points into files and writes the index and chunk
+ * files. All files of a tree share a common path prefix. A tree must not be rebuilt while it is open.
+ *
+ * @note Only available for trivially copyable points.
+ * @note Queries can be run from multiple threads; loading a chunk is serialized.
+ */
+template <typename Point_t>
+class OutOfCorePointOctree {
+	static_assert(std::is_trivially_copyable<Point_t>::value,
+				  "Points are stored in files and have to be trivially copyable.");
+
+public:
+	using point_t = Point_t;
+	using chunk_t = CompactPointOctree<Point_t>;
+
+	class Builder;
+
+private:
+	//! Cell of the in-memory index; the children of a cell are stored consecutively.
+	struct IndexNode {
+		Box box; //!< Bounding box of the cell.
+		uint32_t firstChild; //!< Index of the first child node.
+		uint32_t childCount; //!< Number of consecutive child nodes; zero for leaf cells.
+		uint32_t chunk; //!< Chunk file of a leaf cell; NO_CHUNK for empty leaves and inner cells.
+		uint32_t reserved;
+		uint64_t count; //!< Number of points in the subtree.
+	};
+	static const uint32_t NO_CHUNK = 0xffffffff;
+
+	struct IndexHeader {
+		char magic[8]; //!< "GEOOOCI" and a terminating zero.
+		uint32_t version;
+		uint32_t nodeSize; //!< sizeof(IndexNode)
+		uint32_t pointSize; //!< sizeof(Point_t)
+		uint32_t chunkCount;
+		float minBoxSize;
+		uint32_t maxNumPoints;
+		uint64_t nodeCount;
+	};
+	static const uint32_t INDEX_VERSION = 1;
+
+	static std::string getIndexFileName(const std::string & prefix) {
+		return prefix + ".index";
+	}
+	static std::string getChunkFileName(const std::string & prefix, uint32_t chunk) {
+		return prefix + ".chunk" + std::to_string(chunk);
+	}
+
+	std::string filePrefix;
+	float minBoxSize; //!< Lower bound for side length of cell boundary.
+	uint32_t maxNumPoints; //!< Upper bound for number of points inside a leaf cell of a chunk.
+	uint32_t chunkCount;
+	std::vector<IndexNode> index; //!< The root is stored at index zero.
+
+	struct ResidentChunk {
+		std::shared_ptr<const chunk_t> tree;
+		std::size_t bytes;
+		std::list<uint32_t>::iterator lruPosition;
+	};
+	std::size_t memoryBudget; //!< Upper bound for the size of the resident chunks in bytes.
+	mutable std::mutex cacheMutex; //!< Protects the following cache members.
+	mutable std::unordered_map<uint32_t, ResidentChunk> residentChunks;
+	mutable std::list<uint32_t> recentlyUsedChunks; //!< Most recently used chunk first.
+	mutable std::size_t residentBytes;
+	mutable uint64_t chunkLoads;
+
+	/**
+	 * Return the chunk, loading it if it is not resident. Least recently used chunks are evicted afterwards to respect
+	 * the memory budget; the returned chunk stays valid while it is referenced.
+	 */
+	inline std::shared_ptr<const chunk_t> acquireChunk(uint32_t chunk) const;
+
+	/**
+	 * Call @p visitChunk for every chunk whose cell box fulfills @p touches.
+	 *
+	 * @param touches Function <tt>bool (const Box &)</tt> deciding if a cell has to be visited.
+	 * @param visitChunk Function <tt>bool (const chunk_t &, const Box &)</tt>; @c false stops the traversal.
+	 */
+	template <typename Touches_t, typename VisitChunk_t>
+	inline bool traverse(const Touches_t & touches, VisitChunk_t & visitChunk) const;
+
+public:
+	/**
+	 * Open a tree written by a Builder.
+	 *
+	 * @param prefix Path prefix of the files of the tree.
+	 * @param maximumResidentBytes Memory budget for the cache of loaded chunks. The most recently used chunk is kept
+	 * even if it alone exceeds the budget.
+	 * @throw std::runtime_error if the index cannot be read or is corrupt.
+	 */
+	inline OutOfCorePointOctree(const std::string & prefix, std::size_t maximumResidentBytes);
+
+	OutOfCorePointOctree(const OutOfCorePointOctree &) = delete;
+	OutOfCorePointOctree & operator=(const OutOfCorePointOctree &) = delete;
+
+	const Box & getBox() const {
+		return index.front().box;
+	}
+	float getMinBoxSize() const {
+		return minBoxSize;
+	}
+	uint32_t getMaxNumPoints() const {
+		return maxNumPoints;
+	}
+	//! Return the total number of points.
+	uint64_t size() const {
+		return index.front().count;
+	}
+	bool empty() const {
+		return size() == 0;
+	}
+	//! Return the number of chunk files.
+	uint32_t getNumChunks() const {
+		return chunkCount;
+	}
+
+	/**
+	 * @name Cache information
+	 */
+	//@{
+	std::size_t getMemoryBudget() const {
+		return memoryBudget;
+	}
+	//! Return the size of the resident chunks in bytes.
+	std::size_t getResidentBytes() const {
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		return residentBytes;
+	}
+	std::size_t getNumResidentChunks() const {
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		return residentChunks.size();
+	}
+	//! Return how often a chunk has been loaded from its file.
+	uint64_t getNumChunkLoads() const {
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		return chunkLoads;
+	}
+	//! Release all resident chunks that are not referenced by a running query.
+	void clearCache() const {
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		residentChunks.clear();
+		recentlyUsedChunks.clear();
+		residentBytes = 0;
+	}
+	//@}
+
+	/**
+	 * @name Visitor queries
+	 * Only the chunks touched by the query are loaded.
+	 * @see PointOctree::visitPoints
+	 */
+	//@{
+	template <typename Visitor_t>
+	bool visitPoints(Visitor_t && visitor) const {
+		const auto touches = [](const Box &) { return true; };
+		auto visitChunk = [&visitor](const chunk_t & chunk, const Box &) { return chunk.visitPoints(visitor); };
+		return traverse(touches, visitChunk);
+	}
+
+	template <typename Visitor_t>
+	bool visitPointsWithinBox(const Box & queryBox, Visitor_t && visitor) const {
+		const auto touches = [&queryBox](const Box & box) { return Intersection::isBoxTouchingBox(box, queryBox); };
+		typename chunk_t::traversal_stack_t activeCells;
+		auto visitChunk = [&](const chunk_t & chunk, const Box & box) {
+			return queryBox.contains(box) ? chunk.visitPoints(visitor)
+										  : chunk.visitPointsWithinBox(queryBox, visitor, activeCells);
+		};
+		return traverse(touches, visitChunk);
+	}
+
+	template <typename Visitor_t>
+	bool visitPointsWithinSphere(const Sphere_f & sphere, Visitor_t && visitor) const {
+		const float radiusSquared = sphere.getRadius() * sphere.getRadius();
+		const auto touches = [&](const Box & box) {
+			return box.getDistanceSquared(sphere.getCenter()) <= radiusSquared;
+		};
+		typename chunk_t::traversal_stack_t activeCells;
+		auto visitChunk = [&](const chunk_t & chunk, const Box &) {
+			return chunk.visitPointsWithinSphere(sphere, visitor, activeCells);
+		};
+		return traverse(touches, visitChunk);
+	}
+	//@}
+
+	//! Return all points.
+	void collectPoints(std::deque<Point_t> & out) const {
+		visitPoints([&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+	//! Return all points where the location is within the given box.
+	void collectPointsWithinBox(const Box & box, std::deque<Point_t> & out) const {
+		visitPointsWithinBox(box, [&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+	//! Return all points where the location is within the sphere.
+	void collectPointsWithinSphere(const Sphere_f & sphere, std::deque<Point_t> & out) const {
+		visitPointsWithinSphere(sphere, [&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+};
+
+/**
+ * Streaming construction of an OutOfCorePointOctree.
+ * The points are partitioned top-down into bucket files on disk, one per index cell. A bucket that exceeds the chunk
+ * capacity is read back once and distributed to the children of its cell. Writes to the bucket files are buffered;
+ * the buffers are flushed whenever their total size exceeds the memory budget. finish() converts every bucket into a
+ * chunk file and writes the index.
+ * The peak memory usage is bounded by the memory budget plus the size of the largest bucket.
+ */
+template <typename Point_t>
+class OutOfCorePointOctree<Point_t>::Builder {
+private:
+	using raw_point_t = typename std::aligned_storage<sizeof(Point_t), alignof(Point_t)>::type;
+
+	struct Bucket {
+		Box box;
+		uint32_t firstChild;
+		uint32_t childCount;
+		uint64_t count; //!< Number of points in the subtree, including the buffered points.
+		std::vector<char> buffer; //!< Points not yet written to the file of a leaf bucket.
+
+		explicit Bucket(const Box & _box) : box(_box), firstChild(0), childCount(0), count(0), buffer() {
+		}
+	};
+
+	std::string filePrefix;
+	float minBoxSize;
+	uint32_t maxNumPoints;
+	uint64_t maxChunkPoints;
+	std::size_t memoryBudget;
+	std::vector<Bucket> buckets; //!< The root is stored at index zero; children are stored consecutively.
+	std::size_t bufferedBytes;
+	bool finished;
+
+	std::string getBucketFileName(uint32_t bucket) const {
+		return filePrefix + ".bucket" + std::to_string(bucket);
+	}
+
+	void append(uint32_t bucket, const Point_t & point) {
+		const char * bytes = reinterpret_cast<const char *>(&point);
+		buckets[bucket].buffer.insert(buckets[bucket].buffer.end(), bytes, bytes + sizeof(Point_t));
+		++buckets[bucket].count;
+		bufferedBytes += sizeof(Point_t);
+	}
+
+	void flush(uint32_t bucket) {
+		std::vector<char> & buffer = buckets[bucket].buffer;
+		if (buffer.empty()) {
+			return;
+		}
+		const std::string fileName = getBucketFileName(bucket);
+		std::ofstream out(fileName.c_str(), std::ios::binary | std::ios::app);
+		out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+		out.close();
+		if (!out) {
+			throw std::runtime_error("OutOfCorePointOctree: cannot write \"" + fileName + "\"");
+		}
+		bufferedBytes -= buffer.size();
+		std::vector<char>().swap(buffer);
+	}
+
+	void flushAll() {
+		for (uint32_t i = 0; i < buckets.size(); ++i) {
+			flush(i);
+		}
+	}
+
+	//! Read all points of a leaf bucket into memory and delete its file.
+	std::vector<raw_point_t> takePoints(uint32_t bucket) {
+		flush(bucket);
+		std::vector<raw_point_t> points(static_cast<std::size_t>(buckets[bucket].count));
+		if (points.empty()) {
+			return points;
+		}
+		const std::string fileName = getBucketFileName(bucket);
+		{
+			std::ifstream in(fileName.c_str(), std::ios::binary);
+			in.read(reinterpret_cast<char *>(points.data()),
+					static_cast<std::streamsize>(points.size() * sizeof(Point_t)));
+			if (!in) {
+				throw std::runtime_error("OutOfCorePointOctree: cannot read \"" + fileName + "\"");
+			}
+		}
+		std::remove(fileName.c_str());
+		return points;
+	}
+
+	//! Distribute the points of a full leaf bucket to new child buckets like PointOctree::insert().
+	void split(uint32_t bucket) {
+		const std::vector<raw_point_t> points = takePoints(bucket);
+		const auto newBoxes = Helper::splitBoxCubeLike(buckets[bucket].box);
+		const uint32_t firstChild = static_cast<uint32_t>(buckets.size());
+		buckets[bucket].firstChild = firstChild;
+		buckets[bucket].childCount = static_cast<uint32_t>(newBoxes.size());
+		for (const auto & newBox : newBoxes) {
+			std::remove(getBucketFileName(static_cast<uint32_t>(buckets.size())).c_str());
+			buckets.emplace_back(newBox);
+		}
+		for (const auto & rawPoint : points) {
+			const Point_t & point = reinterpret_cast<const Point_t &>(rawPoint);
+			append(findChild(bucket, point.getPosition()), point);
+		}
+		for (uint32_t i = firstChild; i < firstChild + newBoxes.size(); ++i) {
+			splitIfFull(i);
+		}
+	}
+
+	void splitIfFull(uint32_t bucket) {
+		if (buckets[bucket].count > maxChunkPoints && buckets[bucket].box.getExtentMax() >= minBoxSize * 2.0) {
+			split(bucket);
+		}
+	}
+
+	//! Return the first child of the bucket containing the position; the children cover the whole cell.
+	uint32_t findChild(uint32_t bucket, const Vec3f & pos) const {
+		const uint32_t lastChild = buckets[bucket].firstChild + buckets[bucket].childCount - 1;
+		for (uint32_t i = buckets[bucket].firstChild; i < lastChild; ++i) {
+			if (buckets[i].box.contains(pos)) {
+				return i;
+			}
+		}
+		return lastChild;
+	}
+
+public:
+	/**
+	 * Start building a new tree.
+	 *
+	 * @param prefix Path prefix of the files of the tree. Existing files of a tree with the same prefix are replaced.
+	 * Such a tree must not be open while it is rebuilt, as its chunks are loaded on demand.
+	 * @param boundingBox Bounding box for all points to store.
+	 * @param minimumBoxSize Minimum side length of cells. If this is reached, a cell will not be split anymore.
+	 * @param maximumPoints Maximum number of points in leaf cells of the chunks.
+	 * @param maximumChunkPoints Maximum number of points in a chunk, which has to fit into memory.
+	 * @param maximumBufferedBytes Memory budget for buffered writes.
+	 */
+	Builder(const std::string & prefix, const Box & boundingBox, float minimumBoxSize, uint32_t maximumPoints,
+			uint64_t maximumChunkPoints, std::size_t maximumBufferedBytes)
+			: filePrefix(prefix), minBoxSize(minimumBoxSize), maxNumPoints(maximumPoints),
+			  maxChunkPoints(std::max(maximumChunkPoints, static_cast<uint64_t>(1))),
+			  memoryBudget(maximumBufferedBytes), buckets(), bufferedBytes(0), finished(false) {
+		buckets.emplace_back(boundingBox);
+		std::remove(getBucketFileName(0).c_str());
+	}
+
+	~Builder() {
+		// remove the temporary files of an unfinished build
+		if (!finished) {
+			for (uint32_t i = 0; i < buckets.size(); ++i) {
+				std::remove(getBucketFileName(i).c_str());
+			}
+		}
+	}
+
+	Builder(const Builder &) = delete;
+	Builder & operator=(const Builder &) = delete;
+
+	/**
+	 * Add a point to the tree.
+	 *
+	 * @return @c false if the point is outside of the bounding box.
+	 */
+	bool insert(const Point_t & point) {
+		const Vec3f & pos = point.getPosition();
+		if (finished || !buckets.front().box.contains(pos)) {
+			return false;
+		}
+		uint32_t bucket = 0;
+		while (buckets[bucket].childCount != 0) {
+			++buckets[bucket].count;
+			bucket = findChild(bucket, pos);
+		}
+		append(bucket, point);
+		splitIfFull(bucket);
+		if (bufferedBytes > memoryBudget) {
+			flushAll();
+		}
+		return true;
+	}
+
+	//! Add all points of the range to the tree. @return Number of points inside the bounding box.
+	template <typename Iterator>
+	std::size_t insert(Iterator first, Iterator last) {
+		std::size_t inserted = 0;
+		for (; first != last; ++first) {
+			inserted += insert(*first) ? 1 : 0;
+		}
+		return inserted;
+	}
+
+	/**
+	 * Write the chunk files and the index, and remove the remaining chunk files of a previous tree with the same
+	 * prefix. The tree can then be opened with OutOfCorePointOctree.
+	 *
+	 * @throw std::runtime_error if a file cannot be written.
+	 */
+	void finish() {
+		if (finished) {
+			return;
+		}
+		std::vector<IndexNode> index(buckets.size());
+		uint32_t chunkCount = 0;
+		for (uint32_t i = 0; i < buckets.size(); ++i) {
+			IndexNode & node = index[i];
+			node = IndexNode();
+			node.box = buckets[i].box;
+			node.firstChild = buckets[i].firstChild;
+			node.childCount = buckets[i].childCount;
+			node.count = buckets[i].count;
+			node.chunk = NO_CHUNK;
+			if (node.childCount == 0 && node.count > 0) {
+				const std::vector<raw_point_t> points = takePoints(i);
+				const Point_t * const first = reinterpret_cast<const Point_t *>(points.data());
+				const PointOctree<Point_t> subtree(node.box, minBoxSize, maxNumPoints, first, first + points.size());
+				chunk_t(subtree).saveToFile(getChunkFileName(filePrefix, chunkCount));
+				node.chunk = chunkCount++;
+			}
+		}
+
+		IndexHeader header;
+		std::memset(&header, 0, sizeof(IndexHeader));
+		std::memcpy(header.magic, "GEOOOCI", 8);
+		header.version = INDEX_VERSION;
+		header.nodeSize = sizeof(IndexNode);
+		header.pointSize = sizeof(Point_t);
+		header.chunkCount = chunkCount;
+		header.minBoxSize = minBoxSize;
+		header.maxNumPoints = maxNumPoints;
+		header.nodeCount = index.size();
+		// the index is written last and replaced in one step, so that it never refers to partially written chunks
+		const std::string fileName = getIndexFileName(filePrefix);
+		const std::string tempFileName = fileName + ".tmp";
+		std::ofstream out(tempFileName.c_str(), std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char *>(&header), sizeof(IndexHeader));
+		out.write(reinterpret_cast<const char *>(index.data()),
+				  static_cast<std::streamsize>(index.size() * sizeof(IndexNode)));
+		out.close();
+		if (!out) {
+			std::remove(tempFileName.c_str());
+			throw std::runtime_error("OutOfCorePointOctree: cannot write \"" + fileName + "\"");
+		}
+		try {
+			MappedFile::replaceFile(tempFileName, fileName);
+		} catch (...) {
+			std::remove(tempFileName.c_str());
+			throw;
+		}
+		// chunks of a previous build with more chunks are not referenced anymore; the chunk numbers are consecutive
+		uint32_t staleChunk = chunkCount;
+		while (std::remove(getChunkFileName(filePrefix, staleChunk).c_str()) == 0) {
+			++staleChunk;
+		}
+		finished = true;
+	}
+};
+
+template <typename Point_t>
+inline OutOfCorePointOctree<Point_t>::OutOfCorePointOctree(const std::string & prefix,
+															 std::size_t maximumResidentBytes)
+		: filePrefix(prefix), minBoxSize(0.0f), maxNumPoints(0), chunkCount(0), index(),
+		  memoryBudget(maximumResidentBytes), residentBytes(0), chunkLoads(0) {
+	const std::string fileName = getIndexFileName(prefix);
+	std::ifstream in(fileName.c_str(), std::ios::binary);
+	IndexHeader header;
+	if (!in.read(reinterpret_cast<char *>(&header), sizeof(IndexHeader))) {
+		throw std::runtime_error("OutOfCorePointOctree: cannot read \"" + fileName + "\"");
+	}
+	if (std::memcmp(header.magic, "GEOOOCI", 8) != 0 || header.version != INDEX_VERSION
+		|| header.nodeSize != sizeof(IndexNode) || header.pointSize != sizeof(Point_t) || header.nodeCount == 0) {
+		throw std::runtime_error("OutOfCorePointOctree: unsupported index \"" + fileName + "\"");
+	}
+	// bound the node count by the file size before allocating the index
+	in.seekg(0, std::ios::end);
+	const uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+	in.seekg(static_cast<std::streamoff>(sizeof(IndexHeader)));
+	if (header.nodeCount > (fileSize - sizeof(IndexHeader)) / sizeof(IndexNode)) {
+		throw std::runtime_error("OutOfCorePointOctree: truncated index \"" + fileName + "\"");
+	}
+	minBoxSize = header.minBoxSize;
+	maxNumPoints = header.maxNumPoints;
+	chunkCount = header.chunkCount;
+	index.resize(static_cast<std::size_t>(header.nodeCount));
+	if (!in.read(reinterpret_cast<char *>(index.data()),
+				 static_cast<std::streamsize>(index.size() * sizeof(IndexNode)))) {
+		throw std::runtime_error("OutOfCorePointOctree: truncated index \"" + fileName + "\"");
+	}
+	// the traversal indexes the nodes without checks; children are stored behind their parent, so it terminates
+	for (uint64_t i = 0; i < header.nodeCount; ++i) {
+		const IndexNode & node = index[i];
+		if ((node.childCount != 0
+			 && (node.firstChild <= i || static_cast<uint64_t>(node.firstChild) + node.childCount > header.nodeCount))
+			|| (node.chunk != NO_CHUNK && node.chunk >= chunkCount)) {
+			throw std::runtime_error("OutOfCorePointOctree: corrupt index \"" + fileName + "\"");
+		}
+	}
+}
+
+template <typename Point_t>
+inline std::shared_ptr<const typename OutOfCorePointOctree<Point_t>::chunk_t>
+OutOfCorePointOctree<Point_t>::acquireChunk(uint32_t chunk) const {
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	const auto resident = residentChunks.find(chunk);
+	if (resident != residentChunks.end()) {
+		recentlyUsedChunks.splice(recentlyUsedChunks.begin(), recentlyUsedChunks, resident->second.lruPosition);
+		return resident->second.tree;
+	}
+	std::shared_ptr<const chunk_t> tree =
+			std::make_shared<const chunk_t>(chunk_t::loadFromFile(getChunkFileName(filePrefix, chunk)));
+	ResidentChunk entry;
+	entry.tree = tree;
+	entry.bytes = tree->getNodes().size() * sizeof(typename chunk_t::Node) + tree->size() * sizeof(Point_t);
+	entry.lruPosition = recentlyUsedChunks.insert(recentlyUsedChunks.begin(), chunk);
+	residentBytes += entry.bytes;
+	residentChunks.emplace(chunk, std::move(entry));
+	++chunkLoads;
+
+	while (residentBytes > memoryBudget && recentlyUsedChunks.size() > 1) {
+		const auto evicted = residentChunks.find(recentlyUsedChunks.back());
+		residentBytes -= evicted->second.bytes;
+		residentChunks.erase(evicted);
+		recentlyUsedChunks.pop_back();
+	}
+	return tree;
+}
+
+template <typename Point_t>
+template <typename Touches_t, typename VisitChunk_t>
+inline bool OutOfCorePointOctree<Point_t>::traverse(const Touches_t & touches, VisitChunk_t & visitChunk) const {
+	std::vector<uint32_t> activeCells;
+	activeCells.push_back(0);
+	while (!activeCells.empty()) {
+		const IndexNode & cell = index[activeCells.back()];
+		activeCells.pop_back();
+		if (cell.count == 0 || !touches(cell.box)) {
+			continue;
+		} else if (cell.childCount != 0) {
+			for (uint32_t i = 0; i < cell.childCount; ++i) {
+				activeCells.push_back(cell.firstChild + i);
+			}
+		} else if (cell.chunk != NO_CHUNK) {
+			// keep the chunk alive while it is visited, even if it is evicted in the meantime
+			const std::shared_ptr<const chunk_t> chunk = acquireChunk(cell.chunk);
+			if (!visitChunk(*chunk, cell.box)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+}
+
+#endif /* GEOMETRY_OUTOFCOREPOINTOCTREE_H */
@@ -38,6 +38,37 @@ public:
 		return position;
 	}
 };
+
+/**
+ * Variant of Point that can be assigned, moved, and relocated.
+ * Containers are able to move and reorder the points instead of copying them. This pays off for points carrying large
+ * attributes, which should be derived from this class and be movable themselves.
+ * Containers only hand out const references to stored points, so the position of a stored point can only be changed by
+ * the container (e.g. PointOctree::update()).
+ */
+template <typename Vector_t>
+class MovablePoint {
+private:
+	Vector_t position;
+
+public:
+	typedef Vector_t vector_t;
+
+	explicit MovablePoint(const Vector_t & pos) : position(pos) {
+	}
+
+	bool operator==(const MovablePoint & other) const {
+		return position == other.position;
+	}
+
+	const Vector_t & getPosition() const {
+		return position;
+	}
+
+	void setPosition(const Vector_t & pos) {
+		position = pos;
+	}
+};
 }
 
 #endif /* GEOMETRY_POINT_H */
@@ -0,0 +1,1966 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#ifndef GEOMETRY_POINTTREE_H
+#define GEOMETRY_POINTTREE_H
+
+#include "Box.h"
+#include "BoxIntersection.h"
+#include "Definitions.h"
+#include "Frustum.h"
+#include "Line.h"
+#include "RayBoxIntersection.h"
+#include "Rect.h"
+#include "Sphere.h"
+#include "Vec2.h"
+#include "Vec3.h"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Geometry {
+
+/**
+ * Counters for the work done by a single query of PointTree.
+ * Pass an object to the query overloads accepting counters; the counters are incremented and not reset by the query.
+ */
+struct QueryCounters {
+	uint64_t nodesVisited; //!< Number of cells taken from the traversal stack or queue.
+	uint64_t boxesTested; //!< Number of cell boxes tested against the query region.
+	uint64_t pointsTested; //!< Number of point positions tested against the query region.
+	uint64_t pointsReturned; //!< Number of points passed to the visitor or returned.
+
+	QueryCounters() : nodesVisited(0), boxesTested(0), pointsTested(0), pointsReturned(0) {
+	}
+	void reset() {
+		*this = QueryCounters();
+	}
+
+	void countNode() {
+		++nodesVisited;
+	}
+	void countBox() {
+		++boxesTested;
+	}
+	void countPoint() {
+		++pointsTested;
+	}
+	void countResult(uint64_t number = 1) {
+		pointsReturned += number;
+	}
+};
+
+//! Replacement of QueryCounters used by the uninstrumented queries. All calls are removed by the compiler.
+struct NoQueryCounters {
+	void countNode() {
+	}
+	void countBox() {
+	}
+	void countPoint() {
+	}
+	void countResult(uint64_t = 1) {
+	}
+};
+
+/**
+ * Dimension-specific types and geometric tests used by PointTree.
+ * The specializations for two and three dimensions map the generic operations to _Rect and _Box.
+ */
+template <typename value_t, unsigned int dimension>
+struct PointTreeTraits;
+
+template <typename value_t>
+struct PointTreeTraits<value_t, 2> {
+	using vec_t = _Vec2<value_t>;
+	using box_t = _Rect<value_t>;
+
+	static value_t getMin(const box_t & box, unsigned int axis) {
+		return axis == 0 ? box.getMinX() : box.getMinY();
+	}
+	static value_t getMax(const box_t & box, unsigned int axis) {
+		return axis == 0 ? box.getMaxX() : box.getMaxY();
+	}
+	static box_t createBox(const value_t (&min)[2], const value_t (&max)[2]) {
+		return box_t(min[0], min[1], max[0] - min[0], max[1] - min[1]);
+	}
+	static bool contains(const box_t & box, const vec_t & pos) {
+		return box.contains(pos);
+	}
+	static bool contains(const box_t & box, const box_t & other) {
+		return box.contains(other);
+	}
+	static bool intersects(const box_t & box, const box_t & other) {
+		return box.intersects(other);
+	}
+	static value_t getDistanceSquared(const box_t & box, const vec_t & pos) {
+		return pos.distanceSquared(box.getClosestPoint(pos));
+	}
+};
+
+template <typename value_t>
+struct PointTreeTraits<value_t, 3> {
+	using vec_t = _Vec3<value_t>;
+	using box_t = _Box<value_t>;
+
+	static value_t getMin(const box_t & box, unsigned int axis) {
+		return box.getMin()[axis];
+	}
+	static value_t getMax(const box_t & box, unsigned int axis) {
+		return box.getMax()[axis];
+	}
+	static box_t createBox(const value_t (&min)[3], const value_t (&max)[3]) {
+		return box_t(min[0], max[0], min[1], max[1], min[2], max[2]);
+	}
+	static bool contains(const box_t & box, const vec_t & pos) {
+		return box.contains(pos);
+	}
+	static bool contains(const box_t & box, const box_t & other) {
+		return box.contains(other);
+	}
+	static bool intersects(const box_t & box, const box_t & other) {
+		return Intersection::isBoxTouchingBox(box, other);
+	}
+	static value_t getDistanceSquared(const box_t & box, const vec_t & pos) {
+		return box.getDistanceSquared(pos);
+	}
+};
+
+template <typename Point_t, typename value_t = float, unsigned int dimension = 3>
+class PointTree;
+
+/**
+ * Queries of PointTree that only exist for some scalar types and dimensions. PointTree derives from this class, so
+ * the queries are members of the tree. The primary template adds no queries.
+ */
+template <typename Point_t, typename value_t, unsigned int dimension>
+class PointTreeQueries {};
+
+/**
+ * Queries of the single precision three-dimensional tree (see PointOctree) that are based on the float-only types
+ * Sphere_f, Frustum, Ray3f, and Segment3f: sphere, frustum, ray, segment, and level-of-detail queries.
+ */
+template <typename Point_t>
+class PointTreeQueries<Point_t, float, 3> {
+	using tree_t = PointTree<Point_t, float, 3>;
+	using traversal_stack_t = std::vector<const tree_t *>;
+
+	const tree_t & getTree() const {
+		return static_cast<const tree_t &>(*this);
+	}
+
+	//! Return @c true if the position is inside of all frustum planes selected by @p planeMask.
+	static bool isInsidePlanes(const Frustum & frustum, uint8_t planeMask, const Vec3f & pos) {
+		for (uint_fast8_t plane = 0; plane < 6; ++plane) {
+			if ((planeMask & (1u << plane)) != 0 && frustum.getPlane(static_cast<side_t>(plane)).planeTest(pos) > 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Return the squared distance of the position to the line (ray or segment).
+	 *
+	 * @param[out] param Line parameter of the point on the line closest to @p pos.
+	 */
+	template <typename Line_t>
+	static float getLineDistanceSquared(const Line_t & line, const Vec3f & pos, float & param) {
+		const float projection = line.getDirection().dot(pos - line.getOrigin());
+		param = std::max(line.getMinParam(), std::min(projection, line.getMaxParam()));
+		return (line.getOrigin() + line.getDirection() * param).distanceSquared(pos);
+	}
+
+	/**
+	 * Shared implementation of the ray and segment queries.
+	 * A point within @p radius of the line lies inside a cell, whose box enlarged by @p radius is therefore hit by the
+	 * line. The slope test against the enlarged boxes is used to select the cells.
+	 */
+	template <typename Line_t, typename Visitor_t>
+	inline bool visitPointsNearLine(const Line_t & line, float radius, Visitor_t & visitor,
+									traversal_stack_t & activeCells) const;
+	//! Shared implementation of findFirstPointAlongRay() and findFirstPointAlongSegment().
+	template <typename Line_t>
+	inline const Point_t * findFirstPointAlongLine(const Line_t & line, float radius) const;
+
+	/**
+	 * Recursive part of visitPointsWithinFrustum().
+	 *
+	 * @param planeMask Frustum planes the parent cell is not completely inside of.
+	 */
+	template <typename Visitor_t>
+	inline static bool visitCellWithinFrustum(const tree_t & cell, const Frustum & frustum, uint8_t planeMask,
+											  Visitor_t & visitor, traversal_stack_t & activeCells);
+	//! Recursive part of visitPointsLOD(const Frustum &, ...).
+	template <typename Visitor_t>
+	inline static bool visitCellLOD(const tree_t & cell, const Frustum & frustum, uint8_t planeMask, float maxError,
+									Visitor_t & visitor, traversal_stack_t & activeCells);
+
+public:
+	/**
+	 * Return all points where the location is within the sphere.
+	 *
+	 * @param sphere The sphere describing the query region.
+	 * @param out Points that fulfill the condition are added to this container.
+	 */
+	void collectPointsWithinSphere(const Sphere_f & sphere, std::deque<Point_t> & out) const {
+		getTree().collectPointsWithinRadius(sphere.getCenter(), sphere.getRadius(), out);
+	}
+
+	/**
+	 * Return all points where the location is inside the frustum.
+	 *
+	 * @param frustum The frustum describing the query region.
+	 * @param out Points that fulfill the condition are added to this container.
+	 */
+	void collectPointsWithinFrustum(const Frustum & frustum, std::deque<Point_t> & out) const {
+		visitPointsWithinFrustum(frustum, [&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+
+	/**
+	 * @name Visitor queries
+	 * @see PointTree::visitPoints
+	 */
+	//@{
+	//! Call the visitor for all points within the sphere. @see PointTree::visitPointsWithinRadius
+	template <typename Visitor_t, typename Counters_t>
+	bool visitPointsWithinSphere(const Sphere_f & sphere, Visitor_t && visitor, traversal_stack_t & activeCells,
+								 Counters_t & counters) const {
+		return getTree().visitPointsWithinRadius(sphere.getCenter(), sphere.getRadius(),
+												 std::forward<Visitor_t>(visitor), activeCells, counters);
+	}
+	template <typename Visitor_t>
+	bool visitPointsWithinSphere(const Sphere_f & sphere, Visitor_t && visitor, traversal_stack_t & activeCells) const {
+		return getTree().visitPointsWithinRadius(sphere.getCenter(), sphere.getRadius(),
+												 std::forward<Visitor_t>(visitor), activeCells);
+	}
+	template <typename Visitor_t>
+	bool visitPointsWithinSphere(const Sphere_f & sphere, Visitor_t && visitor) const {
+		return getTree().visitPointsWithinRadius(sphere.getCenter(), sphere.getRadius(),
+												 std::forward<Visitor_t>(visitor));
+	}
+
+	/**
+	 * Call the visitor for all points inside the frustum. Subtrees completely inside the frustum are accepted without
+	 * further tests, and the children of a cell are only tested against the planes the cell intersects.
+	 */
+	template <typename Visitor_t>
+	bool visitPointsWithinFrustum(const Frustum & frustum, Visitor_t && visitor,
+								  traversal_stack_t & activeCells) const {
+		activeCells.clear();
+		return visitCellWithinFrustum(getTree(), frustum, 0x3f, visitor, activeCells);
+	}
+	template <typename Visitor_t>
+	bool visitPointsWithinFrustum(const Frustum & frustum, Visitor_t && visitor) const {
+		traversal_stack_t activeCells;
+		return visitCellWithinFrustum(getTree(), frustum, 0x3f, visitor, activeCells);
+	}
+	//@}
+
+	/**
+	 * @name Level of detail queries
+	 * @see PointTree::enableLodSamples
+	 */
+	//@{
+	/**
+	 * Call the visitor for a level-of-detail representation of the points within the box. The traversal stops at
+	 * the first cell whose side length is at most @p maxError and visits the samples of that cell instead of its
+	 * subtree. Without LOD samples, all points within the box are visited.
+	 */
+	template <typename Visitor_t>
+	inline bool visitPointsLOD(const Box & box, float maxError, Visitor_t && visitor,
+							   traversal_stack_t & activeCells) const;
+	template <typename Visitor_t>
+	bool visitPointsLOD(const Box & box, float maxError, Visitor_t && visitor) const {
+		traversal_stack_t activeCells;
+		return visitPointsLOD(box, maxError, std::forward<Visitor_t>(visitor), activeCells);
+	}
+
+	/**
+	 * Call the visitor for a level-of-detail representation of the points inside the frustum.
+	 * The screen-space error of a cell is its side length divided by its distance to the camera position, which
+	 * approximates the size of the cell on screen in radians; for orthogonal frustums it is the side length itself.
+	 * The traversal stops at the first cell with an error of at most @p maxError and visits its samples.
+	 */
+	template <typename Visitor_t>
+	bool visitPointsLOD(const Frustum & frustum, float maxError, Visitor_t && visitor,
+						traversal_stack_t & activeCells) const {
+		activeCells.clear();
+		return visitCellLOD(getTree(), frustum, 0x3f, maxError, visitor, activeCells);
+	}
+	template <typename Visitor_t>
+	bool visitPointsLOD(const Frustum & frustum, float maxError, Visitor_t && visitor) const {
+		traversal_stack_t activeCells;
+		return visitCellLOD(getTree(), frustum, 0x3f, maxError, visitor, activeCells);
+	}
+
+	//! Return a level-of-detail representation of the points within the box. @see visitPointsLOD
+	void collectPointsLOD(const Box & box, float maxError, std::deque<Point_t> & out) const {
+		visitPointsLOD(box, maxError, [&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+	//! Return a level-of-detail representation of the points inside the frustum. @see visitPointsLOD
+	void collectPointsLOD(const Frustum & frustum, float maxError, std::deque<Point_t> & out) const {
+		visitPointsLOD(frustum, maxError, [&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+	//@}
+
+	/**
+	 * @name Ray and segment queries
+	 * Query the points with a distance of at most @p radius to a ray or segment.
+	 * @note The direction of the ray is required to have unit length.
+	 */
+	//@{
+	//! Call the visitor for all points near the ray. The visitor returns @c false to stop the traversal.
+	template <typename Visitor_t>
+	bool visitPointsNearRay(const Ray3f & ray, float radius, Visitor_t && visitor,
+							traversal_stack_t & activeCells) const {
+		return visitPointsNearLine(ray, radius, visitor, activeCells);
+	}
+	template <typename Visitor_t>
+	bool visitPointsNearRay(const Ray3f & ray, float radius, Visitor_t && visitor) const {
+		traversal_stack_t activeCells;
+		return visitPointsNearLine(ray, radius, visitor, activeCells);
+	}
+
+	//! Call the visitor for all points near the segment. The visitor returns @c false to stop the traversal.
+	template <typename Visitor_t>
+	bool visitPointsNearSegment(const Segment3f & segment, float radius, Visitor_t && visitor,
+								traversal_stack_t & activeCells) const {
+		return visitPointsNearLine(segment, radius, visitor, activeCells);
+	}
+	template <typename Visitor_t>
+	bool visitPointsNearSegment(const Segment3f & segment, float radius, Visitor_t && visitor) const {
+		traversal_stack_t activeCells;
+		return visitPointsNearLine(segment, radius, visitor, activeCells);
+	}
+
+	//! Return all points near the ray.
+	void collectPointsNearRay(const Ray3f & ray, float radius, std::deque<Point_t> & out) const {
+		visitPointsNearRay(ray, radius, [&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+	//! Return all points near the segment.
+	void collectPointsNearSegment(const Segment3f & segment, float radius, std::deque<Point_t> & out) const {
+		visitPointsNearSegment(segment, radius, [&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+
+	/**
+	 * Return the first point hit along the ray, which is the point near the ray whose closest point on the ray has
+	 * the smallest ray parameter. The cells are visited front-to-back and the search stops as soon as no remaining
+	 * cell can contain an earlier hit.
+	 *
+	 * @return Pointer to the point inside the tree, or nullptr if no point is near the ray.
+	 */
+	const Point_t * findFirstPointAlongRay(const Ray3f & ray, float radius) const {
+		return findFirstPointAlongLine(ray, radius);
+	}
+	//! Return the first point hit along the segment. @see findFirstPointAlongRay
+	const Point_t * findFirstPointAlongSegment(const Segment3f & segment, float radius) const {
+		return findFirstPointAlongLine(segment, radius);
+	}
+	//@}
+};
+
+/**
+ * Spatial tree storing points in a hierarchy of axis-aligned cells, generic over the scalar type and the dimension.
+ * A cell is split like Helper::splitBoxCubeLike(): along every axis whose extent is not smaller than the largest
+ * extent divided by sqrt(2). With two dimensions, the tree is a quadtree (see PointQuadtree) using _Rect and _Vec2;
+ * with three dimensions, it is an octree using _Box and _Vec3. All dimension-specific operations are resolved at
+ * compile time.
+ *
+ * The single precision three-dimensional tree is PointOctree. It additionally provides the queries of
+ * PointTreeQueries<Point_t, float, 3> and can be converted into a CompactPointOctree.
+ *
+ * @tparam Point_t Point type with a member function getPosition() returning a vec_t.
+ * @tparam value_t Scalar type of the coordinates.
+ * @tparam dimension Number of dimensions (two or three).
+ * @author Benjamin Eikel, Jonas Knoll
+ * @date 2011-02-08
+ */
+template <typename Point_t, typename value_t, unsigned int dimension>
+class PointTree : public PointTreeQueries<Point_t, value_t, dimension> {
+	friend class PointTreeQueries<Point_t, value_t, dimension>;
+
+public:
+	using traits_t = PointTreeTraits<value_t, dimension>;
+	using vec_t = typename traits_t::vec_t;
+	using box_t = typename traits_t::box_t;
+	using point_t = Point_t;
+	//! Stack of cells used by the traversal of a query. Reuse it between queries to avoid allocations.
+	using traversal_stack_t = std::vector<const PointTree *>;
+	using children_t = std::vector<PointTree>;
+
+	//! Representative point of a cell. @see enableLodSamples()
+	struct LodSample {
+		uint32_t key; //!< Pseudo-random key derived from the position; the samples have the smallest keys.
+		Point_t point;
+
+		LodSample(uint32_t _key, const Point_t & _point) : key(_key), point(_point) {
+		}
+	};
+
+	//! Description of the shape of a tree. @see getStatistics()
+	struct Statistics {
+		std::size_t nodeCount; //!< Number of cells including the root.
+		std::size_t leafCount; //!< Number of cells without children.
+		std::size_t pointCount; //!< Number of stored points.
+		std::vector<std::size_t> depthHistogram; //!< Number of cells at each depth; the root has depth zero.
+		std::vector<std::size_t> leafOccupancyHistogram; //!< Number of leaves storing the index number of points.
+		std::size_t memoryFootprint; //!< Estimated memory usage in bytes, ignoring the overhead of the allocator.
+
+		Statistics() : nodeCount(0), leafCount(0), pointCount(0), memoryFootprint(0) {
+		}
+	};
+
+private:
+	//! Maximum number of children of a cell.
+	static constexpr unsigned int maxChildCount = 1u << dimension;
+
+	// the small members are stored together, so that they share the padding in front of the box
+	value_t minBoxSize; //!< Lower bound for side length of cell boundary.
+	uint32_t maxNumPoints; //!< Upper bound for number of points inside a leaf cell.
+	uint32_t lodSampleCount; //!< Maximum number of LOD samples per cell; zero if disabled.
+	//! @c true if update() has changed the subtree and splits or merges may be pending. @see flushUpdates()
+	bool updatesPending;
+
+	box_t box; //!< Bounding box of the cell.
+	children_t children; //!< Child cells; empty for leaves.
+	std::deque<Point_t> points; //!< Points that are stored directly inside this cell.
+	std::vector<LodSample> lodSamples; //!< Points of the subtree with the smallest keys, ordered by key.
+
+	value_t getExtentMax() const {
+		value_t extentMax = 0;
+		for (unsigned int axis = 0; axis < dimension; ++axis) {
+			extentMax = std::max(extentMax, traits_t::getMax(box, axis) - traits_t::getMin(box, axis));
+		}
+		return extentMax;
+	}
+
+	//! Return @c true if a leaf holding @p count points has to be split.
+	bool needsSplit(std::size_t count) const {
+		return count > maxNumPoints && getExtentMax() >= minBoxSize * 2;
+	}
+
+	//! Return the squared distance to the point of the box farthest away from @p pos.
+	value_t getMaxDistanceSquared(const vec_t & pos) const {
+		value_t distSquared = 0;
+		for (unsigned int axis = 0; axis < dimension; ++axis) {
+			const value_t toMin = pos.getVec()[axis] - traits_t::getMin(box, axis);
+			const value_t toMax = traits_t::getMax(box, axis) - pos.getVec()[axis];
+			distSquared += std::max(toMin * toMin, toMax * toMax);
+		}
+		return distSquared;
+	}
+
+	//! Return the key of a position used for choosing the LOD samples (a hash of the coordinates).
+	static uint32_t getLodKey(const vec_t & pos) {
+		uint32_t key = 2166136261u;
+		for (unsigned int axis = 0; axis < dimension; ++axis) {
+			uint32_t words[(sizeof(value_t) + sizeof(uint32_t) - 1) / sizeof(uint32_t)] = {};
+			std::memcpy(words, pos.getVec() + axis, sizeof(value_t));
+			for (const uint32_t word : words) {
+				key = (key ^ word) * 16777619u;
+			}
+		}
+		// final mixing step of MurmurHash3
+		key ^= key >> 16;
+		key *= 0x85ebca6bu;
+		key ^= key >> 13;
+		key *= 0xc2b2ae35u;
+		key ^= key >> 16;
+		return key;
+	}
+
+	//! Return the first child cell containing the position, or nullptr.
+	const PointTree * findChild(const vec_t & pos) const {
+		for (const auto & child : children) {
+			if (traits_t::contains(child.box, pos)) {
+				return &child;
+			}
+		}
+		return nullptr;
+	}
+	PointTree * findChild(const vec_t & pos) {
+		return const_cast<PointTree *>(static_cast<const PointTree *>(this)->findChild(pos));
+	}
+
+	//! Add the point to the LOD samples of this cell if its key is among the smallest ones.
+	inline void offerLodSample(const Point_t & point, uint32_t key);
+	//! Recalculate the LOD samples of the subtree bottom-up.
+	inline void calculateLodSamples();
+	//! Remove the LOD samples selected by the predicate.
+	template <typename Predicate_t>
+	void eraseLodSamplesIf(Predicate_t & predicate) {
+		if (lodSamples.empty()) {
+			return;
+		}
+		std::vector<LodSample> remainingSamples;
+		remainingSamples.reserve(lodSamples.size());
+		for (const auto & sample : lodSamples) {
+			if (!predicate(sample.point)) {
+				remainingSamples.push_back(sample);
+			}
+		}
+		lodSamples.swap(remainingSamples);
+	}
+
+	//! Erase the points of this leaf for which the predicate is @c true, in place if points are assignable.
+	template <typename Predicate_t>
+	inline std::size_t erasePointsIf(Predicate_t & predicate, std::true_type isMoveAssignable);
+	template <typename Predicate_t>
+	inline std::size_t erasePointsIf(Predicate_t & predicate, std::false_type isMoveAssignable);
+
+	/**
+	 * Turn this cell into a leaf if all children are leaves holding less than maxNumPoints points together.
+	 *
+	 * @return @c true if the children have been merged.
+	 */
+	inline bool mergeChildrenIfSmall();
+
+	//! Common implementation of the insert() variants copying or moving the point.
+	template <typename PointRef_t>
+	inline bool insertPoint(PointRef_t && point);
+
+	//! Create the (empty) children of this cell.
+	inline void createChildren();
+
+	//! Create the children of this leaf and move the points into them.
+	inline void split();
+
+	template <typename Predicate_t>
+	inline std::size_t removeIfWithin(Predicate_t & predicate, const box_t & region);
+
+	//! Return iterators to all points of the range that are located inside this cell.
+	template <typename Iterator>
+	std::vector<Iterator> referencePointsInside(Iterator first, Iterator last) const {
+		std::vector<Iterator> references;
+		for (; first != last; ++first) {
+			if (traits_t::contains(box, (*first).getPosition())) {
+				references.push_back(first);
+			}
+		}
+		return references;
+	}
+
+	/**
+	 * Build the subtree of this (empty) cell from the points referenced by <tt>source[begin, end)</tt>.
+	 * The references are partitioned stably into @p target; the buffers swap roles on every level.
+	 *
+	 * @param childSlots Scratch buffer with one entry per reference.
+	 */
+	template <typename Iterator>
+	void buildFromRange(std::vector<Iterator> & source, std::vector<Iterator> & target,
+						std::vector<uint8_t> & childSlots, std::size_t begin, std::size_t end);
+
+	/**
+	 * Execute a single level of buildFromRange(): either store the referenced points in this leaf, or split this cell
+	 * and partition the references into @p target.
+	 *
+	 * @param[out] childBegin Begin of the range of every child inside @p target.
+	 * @param[out] childEnd End of the range of every child inside @p target.
+	 * @return @c true if the cell has been split, @c false if it stores the points itself.
+	 */
+	template <typename Iterator>
+	bool distributeRange(std::vector<Iterator> & source, std::vector<Iterator> & target,
+						 std::vector<uint8_t> & childSlots, std::size_t begin, std::size_t end,
+						 std::size_t (&childBegin)[maxChildCount], std::size_t (&childEnd)[maxChildCount]);
+
+	/**
+	 * Build the subtree of this cell like buildFromRange(), but distribute independent subtrees with more than
+	 * @p sequentialCutoff points to a pool of @p numThreads threads.
+	 */
+	template <typename Iterator>
+	void buildFromRangeParallel(std::vector<Iterator> & source, std::vector<Iterator> & target,
+								std::vector<uint8_t> & childSlots, unsigned int numThreads,
+								std::size_t sequentialCutoff);
+
+	/**
+	 * Best-first k-nearest-neighbor search.
+	 *
+	 * @param epsilon Cells farther away than the current k-th distance divided by <tt>1 + epsilon</tt> are pruned.
+	 * @param[out] result Pairs of squared distance and point, ordered by increasing distance.
+	 */
+	template <typename Counters_t>
+	inline void findClosestPoints(const vec_t & pos, uint64_t count, value_t epsilon,
+								  std::vector<std::pair<value_t, const Point_t *>> & result,
+								  Counters_t & counters) const;
+
+	/**
+	 * Call the visitor for all points in the subtree.
+	 * The traversal uses the free part of @p activeCells above the current entries and leaves those untouched.
+	 */
+	template <typename Visitor_t, typename Counters_t>
+	inline static bool visitSubtree(const PointTree * subtree, Visitor_t & visitor, traversal_stack_t & activeCells,
+									Counters_t & counters);
+	template <typename Visitor_t>
+	static bool visitSubtree(const PointTree * subtree, Visitor_t & visitor, traversal_stack_t & activeCells) {
+		NoQueryCounters counters;
+		return visitSubtree(subtree, visitor, activeCells, counters);
+	}
+
+	//! Add the cells of the subtree to the statistics.
+	inline void collectStatistics(Statistics & statistics, std::size_t depth) const;
+
+public:
+	/**
+	 * Create a new tree for points within the given bounds.
+	 *
+	 * @param boundingBox Bounding box for all points to store.
+	 * @param minimumBoxSize Minimum side length of leaf cells. If this is reached, the leaf will not be split anymore.
+	 * @param maximumPoints Maximum number of points in leaf cells. If this is reached, a leaf will be split.
+	 */
+	PointTree(const box_t & boundingBox, value_t minimumBoxSize, uint32_t maximumPoints)
+			: minBoxSize(minimumBoxSize), maxNumPoints(maximumPoints), lodSampleCount(0), updatesPending(false),
+			  box(boundingBox), children() {
+	}
+
+	/**
+	 * Create a new tree and bulk load the points of the given range.
+	 * The points are partitioned top-down and every cell is created exactly once. The resulting tree is identical to
+	 * the one created by inserting the points one after another in the order of the range.
+	 *
+	 * @param boundingBox Bounding box for all points to store. Points outside are ignored.
+	 * @param minimumBoxSize Minimum side length of leaf cells. If this is reached, the leaf will not be split anymore.
+	 * @param maximumPoints Maximum number of points in leaf cells. If this is reached, a leaf will be split.
+	 * @param first Forward iterator to the first point.
+	 * @param last Forward iterator behind the last point.
+	 */
+	template <typename Iterator>
+	PointTree(const box_t & boundingBox, value_t minimumBoxSize, uint32_t maximumPoints, Iterator first, Iterator last)
+			: minBoxSize(minimumBoxSize), maxNumPoints(maximumPoints), lodSampleCount(0), updatesPending(false),
+			  box(boundingBox), children() {
+		std::vector<Iterator> references = referencePointsInside(first, last);
+		std::vector<Iterator> buffer(references.size());
+		std::vector<uint8_t> childSlots(references.size());
+		buildFromRange(references, buffer, childSlots, 0, references.size());
+	}
+
+	/**
+	 * Create a new tree and bulk load the points of the given range using multiple threads.
+	 * After a cell has been split, its child subtrees are built independently by a pool of threads. Subtrees with
+	 * at most @p sequentialCutoff points are built by a single thread. The resulting tree does not depend on the
+	 * number of threads and is identical to the one created by the sequential bulk-load constructor.
+	 *
+	 * @param numThreads Number of threads including the calling thread. Zero uses the number of hardware threads.
+	 * @param sequentialCutoff Maximum number of points in a subtree that is not split into further tasks.
+	 * @see PointTree(const box_t &, value_t, uint32_t, Iterator, Iterator)
+	 */
+	template <typename Iterator>
+	PointTree(const box_t & boundingBox, value_t minimumBoxSize, uint32_t maximumPoints, Iterator first, Iterator last,
+			  unsigned int numThreads, std::size_t sequentialCutoff = 65536)
+			: minBoxSize(minimumBoxSize), maxNumPoints(maximumPoints), lodSampleCount(0), updatesPending(false),
+			  box(boundingBox), children() {
+		std::vector<Iterator> references = referencePointsInside(first, last);
+		std::vector<Iterator> buffer(references.size());
+		std::vector<uint8_t> childSlots(references.size());
+		buildFromRangeParallel(references, buffer, childSlots, numThreads, sequentialCutoff);
+	}
+
+	const box_t & getBox() const {
+		return box;
+	}
+	value_t getMinBoxSize() const {
+		return minBoxSize;
+	}
+	uint32_t getMaxNumPoints() const {
+		return maxNumPoints;
+	}
+	bool hasChildren() const {
+		return !children.empty();
+	}
+	bool isLeaf() const {
+		return children.empty();
+	}
+	bool empty() const {
+		return children.empty() && points.empty();
+	}
+	//! Return the child cells. The container is empty for leaf cells.
+	const children_t & getChildren() const {
+		return children;
+	}
+	//! Return the points stored directly inside this cell. Only leaf cells store points.
+	const std::deque<Point_t> & getPoints() const {
+		return points;
+	}
+
+	/**
+	 * Delete all child nodes and all points.
+	 */
+	void clear() {
+		children.clear();
+		points.clear();
+		lodSamples.clear();
+		updatesPending = false;
+	}
+
+	/**
+	 * Insert the point into the tree.
+	 *
+	 * @param point Data item containing the position.
+	 * @return @c true if the point has been inserted, @c false if it is outside of the tree.
+	 */
+	bool insert(const Point_t & point) {
+		return insertPoint(point);
+	}
+
+	/**
+	 * Move the point into the tree. When a leaf is split, its points are moved to the new children as well, so a
+	 * movable point type (e.g. derived from MovablePoint) is never copied by the insertion.
+	 *
+	 * @param point Data item containing the position. It is left unchanged if it is outside of the tree.
+	 * @return @c true if the point has been inserted, @c false if it is outside of the tree.
+	 */
+	bool insert(Point_t && point) {
+		return insertPoint(std::move(point));
+	}
+
+	/**
+	 * Construct a point from the given arguments and move it into the tree.
+	 *
+	 * @return @c true if the point has been inserted, @c false if it is outside of the tree.
+	 */
+	template <typename... Args>
+	bool emplace(Args &&... args) {
+		return insertPoint(Point_t(std::forward<Args>(args)...));
+	}
+
+	/**
+	 * Move a point to a new position. If the new position is inside of the point's leaf, the point is changed in
+	 * place. Otherwise, it is moved to the leaf below the lowest common ancestor of both positions. Splitting the new
+	 * leaf and merging the cells above the old leaf are deferred until flushUpdates() is called, e.g. once per frame
+	 * after all points have been moved. Until then, leaves may contain more than maxNumPoints points.
+	 *
+	 * @param oldPoint Point that is compared with operator== to the stored points; the first match is moved. Its LOD
+	 * samples are matched in the same way, so points at the same position need an identifying operator== to keep
+	 * their own samples.
+	 * @param newPosition New position of the point. Point_t needs a member function setPosition(const vec_t &) for
+	 * changing it (see MovablePoint).
+	 * @return @c true if the point has been moved, @c false if it has not been found or the new position is outside
+	 * of the tree.
+	 */
+	inline bool update(const Point_t & oldPoint, const vec_t & newPosition);
+
+	//! Perform the splits and merges deferred by update().
+	inline void flushUpdates();
+
+	/**
+	 * Removes the point from the tree.
+	 * All points at the position of the given point are removed from their leaf in place. Afterwards, leaves are
+	 * merged into their parent bottom-up as long as they together hold less than the maximum number of points.
+	 *
+	 * @param point Data item containing the position.
+	 * @return @c true if at least one point has been removed.
+	 */
+	inline bool remove(const Point_t & point);
+
+	/**
+	 * Remove all points inside the given region for which the predicate returns @c true.
+	 * Every affected cell is visited and merged at most once.
+	 *
+	 * @param predicate Functor that is called with a const reference to a point. It is also applied to the LOD
+	 * samples of the affected cells.
+	 * @param region Only points inside this box are considered.
+	 * @return Number of removed points.
+	 */
+	template <typename Predicate_t>
+	std::size_t removeIf(Predicate_t predicate, const box_t & region) {
+		return removeIfWithin(predicate, region);
+	}
+	//! Remove all points for which the predicate returns @c true.
+	template <typename Predicate_t>
+	std::size_t removeIf(Predicate_t predicate) {
+		return removeIfWithin(predicate, box);
+	}
+
+	/**
+	 * Return the leaf node containing the given point or nullptr if the point is outside the tree.
+	 *
+	 * @param point Point
+	 * @return Leaf node or nullptr.
+	 */
+	const PointTree * findLeafCell(const vec_t & point) const {
+		if (!traits_t::contains(box, point)) {
+			return nullptr;
+		}
+		const PointTree * cell = this;
+		while (cell != nullptr && cell->hasChildren()) {
+			cell = cell->findChild(point);
+		}
+		return cell;
+	}
+	PointTree * findLeafCell(const vec_t & point) {
+		return const_cast<PointTree *>(static_cast<const PointTree *>(this)->findLeafCell(point));
+	}
+
+	/**
+	 * Return all points.
+	 *
+	 * @param out Points in the tree.
+	 */
+	void collectPoints(std::deque<Point_t> & out) const {
+		visitPoints([&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+
+	/**
+	 * Return all points where the location is within the given box.
+	 *
+	 * @param queryBox
+	 * @param out Points that fulfill the condition are added to this container.
+	 */
+	void collectPointsWithinBox(const box_t & queryBox, std::deque<Point_t> & out) const {
+		visitPointsWithinBox(queryBox, [&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+
+	/**
+	 * Return all points with a distance of at most @p radius to @p center.
+	 *
+	 * @param out Points that fulfill the condition are added to this container.
+	 */
+	void collectPointsWithinRadius(const vec_t & center, value_t radius, std::deque<Point_t> & out) const {
+		visitPointsWithinRadius(center, radius, [&out](const Point_t & p) {
+			out.push_back(p);
+			return true;
+		});
+	}
+
+	/**
+	 * @name Visitor queries
+	 * The visitor is called with a const reference to every point fulfilling the condition and returns @c false to
+	 * stop the traversal. The functions return @c false if the traversal has been stopped by the visitor.
+	 * Passing a traversal stack that is reused between queries avoids all heap allocations of the traversal.
+	 * The box and radius queries accept an optional QueryCounters object that records the work done by the query.
+	 */
+	//@{
+	template <typename Visitor_t>
+	bool visitPoints(Visitor_t && visitor, traversal_stack_t & activeCells) const {
+		activeCells.clear();
+		return visitSubtree(this, visitor, activeCells);
+	}
+	template <typename Visitor_t>
+	bool visitPoints(Visitor_t && visitor) const {
+		traversal_stack_t activeCells;
+		return visitPoints(std::forward<Visitor_t>(visitor), activeCells);
+	}
+
+	template <typename Visitor_t, typename Counters_t>
+	inline bool visitPointsWithinBox(const box_t & queryBox, Visitor_t && visitor, traversal_stack_t & activeCells,
+									 Counters_t & counters) const;
+	template <typename Visitor_t>
+	bool visitPointsWithinBox(const box_t & queryBox, Visitor_t && visitor, traversal_stack_t & activeCells) const {
+		NoQueryCounters counters;
+		return visitPointsWithinBox(queryBox, std::forward<Visitor_t>(visitor), activeCells, counters);
+	}
+	template <typename Visitor_t>
+	bool visitPointsWithinBox(const box_t & queryBox, Visitor_t && visitor) const {
+		traversal_stack_t activeCells;
+		return visitPointsWithinBox(queryBox, std::forward<Visitor_t>(visitor), activeCells);
+	}
+
+	//! Call the visitor for all points with a distance of at most @p radius to @p center.
+	template <typename Visitor_t, typename Counters_t>
+	inline bool visitPointsWithinRadius(const vec_t & center, value_t radius, Visitor_t && visitor,
+										traversal_stack_t & activeCells, Counters_t & counters) const;
+	template <typename Visitor_t>
+	bool visitPointsWithinRadius(const vec_t & center, value_t radius, Visitor_t && visitor,
+								 traversal_stack_t & activeCells) const {
+		NoQueryCounters counters;
+		return visitPointsWithinRadius(center, radius, std::forward<Visitor_t>(visitor), activeCells, counters);
+	}
+	template <typename Visitor_t>
+	bool visitPointsWithinRadius(const vec_t & center, value_t radius, Visitor_t && visitor) const {
+		traversal_stack_t activeCells;
+		return visitPointsWithinRadius(center, radius, std::forward<Visitor_t>(visitor), activeCells);
+	}
+	//@}
+
+	/**
+	 * Return the @p count points closest to the given position.
+	 * The cells are visited best-first ordered by their distance to @p pos, and the search stops as soon as no
+	 * remaining cell can contain a closer point. Every cell is visited at most once.
+	 *
+	 * @param pos Query position. If it is outside of the tree, @p out is not changed.
+	 * @param count Maximum number of points to return.
+	 * @param out Is cleared and filled with the closest points ordered by increasing distance.
+	 */
+	void getClosestPoints(const vec_t & pos, uint64_t count, std::deque<Point_t> & out) const {
+		NoQueryCounters counters;
+		getClosestPoints(pos, count, out, counters);
+	}
+	//! Variant of getClosestPoints() recording the work done by the query in @p counters.
+	template <typename Counters_t>
+	inline void getClosestPoints(const vec_t & pos, uint64_t count, std::deque<Point_t> & out,
+								 Counters_t & counters) const;
+
+	//! Return the @p count points closest to the given position ordered by increasing distance.
+	std::deque<Point_t> getSortedClosestPoints(const vec_t & pos, uint64_t count) const {
+		// getClosestPoints() already returns the points ordered by distance
+		std::deque<Point_t> sortedClosestPoints;
+		getClosestPoints(pos, count, sortedClosestPoints);
+		return sortedClosestPoints;
+	}
+
+	/**
+	 * Return @p count points that are approximately the closest points to the given position.
+	 * The search prunes every cell that is farther away than the distance of the current k-th point divided by
+	 * <tt>1 + epsilon</tt>. Therefore, the distance of the i-th returned point is at most <tt>1 + epsilon</tt> times
+	 * the distance of the exact i-th closest point, while large parts of dense point clouds are not visited at all.
+	 *
+	 * @param pos Query position. If it is outside of the tree, @p out is not changed.
+	 * @param count Maximum number of points to return.
+	 * @param epsilon Allowed relative distance error; zero gives the same result as getClosestPoints().
+	 * @param out Is cleared and filled with the found points ordered by increasing distance.
+	 * @throw std::invalid_argument if @p epsilon is negative.
+	 */
+	void getApproximateClosestPoints(const vec_t & pos, uint64_t count, value_t epsilon,
+									 std::deque<Point_t> & out) const {
+		NoQueryCounters counters;
+		getApproximateClosestPoints(pos, count, epsilon, out, counters);
+	}
+	//! Variant of getApproximateClosestPoints() recording the work done by the query in @p counters.
+	template <typename Counters_t>
+	inline void getApproximateClosestPoints(const vec_t & pos, uint64_t count, value_t epsilon,
+											std::deque<Point_t> & out, Counters_t & counters) const;
+
+	/**
+	 * Return the number of cells, their distribution over the depths, the occupancy of the leaves, and the estimated
+	 * memory usage of the tree. The values can be used to choose minBoxSize and maxNumPoints for a data set.
+	 */
+	Statistics getStatistics() const {
+		Statistics statistics;
+		statistics.memoryFootprint = sizeof(PointTree);
+		collectStatistics(statistics, 0);
+		return statistics;
+	}
+
+	/**
+	 * @name Level of detail
+	 * Every cell can store a bounded sample of the points of its subtree. The samples are the points with the
+	 * smallest pseudo-random keys derived from their positions, which makes them a uniform sample of the subtree that
+	 * does not depend on the insertion order. As a cell keeps the smallest keys of its subtree, its samples are a
+	 * subset of the union of its children's samples, so a coarser level never shows points that vanish at a finer
+	 * level.
+	 * The samples are kept up to date when points are inserted. Removed points are removed from the samples, which
+	 * can leave fewer samples than the maximum; enableLodSamples() recalculates them.
+	 * The queries using the samples are provided by PointTreeQueries (see PointOctree).
+	 */
+	//@{
+	/**
+	 * Store up to @p count samples in every cell and calculate them for the current points. The samples are
+	 * maintained by all following insertions. A count of zero removes the samples.
+	 */
+	void enableLodSamples(uint32_t count) {
+		lodSampleCount = count;
+		calculateLodSamples();
+	}
+	//! Return the maximum number of LOD samples per cell; zero if disabled.
+	uint32_t getLodSampleCount() const {
+		return lodSampleCount;
+	}
+	//! Return the LOD samples of this cell ordered by key.
+	const std::vector<LodSample> & getLodSamples() const {
+		return lodSamples;
+	}
+	//@}
+};
+
+//! Two-dimensional PointTree using _Rect and _Vec2.
+template <typename Point_t, typename value_t = float>
+using PointQuadtree = PointTree<Point_t, value_t, 2>;
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+constexpr unsigned int PointTree<Point_t, value_t, dimension>::maxChildCount;
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename PointRef_t>
+inline bool PointTree<Point_t, value_t, dimension>::insertPoint(PointRef_t && point) {
+	// make sure point is within boundary
+	if (!traits_t::contains(box, point.getPosition())) {
+		return false;
+	} else if (isLeaf()) {
+		// add new point
+		points.push_back(std::forward<PointRef_t>(point));
+		if (lodSampleCount != 0) {
+			offerLodSample(points.back(), getLodKey(points.back().getPosition()));
+		}
+
+		// need to split?
+		if (needsSplit(points.size())) {
+			split();
+		}
+		return true;
+	} else {
+		PointTree * leaf = findLeafCell(point.getPosition());
+		if (leaf == nullptr) {
+			return false;
+		}
+		if (lodSampleCount != 0) {
+			// update the samples of the inner cells on the path to the leaf
+			const uint32_t key = getLodKey(point.getPosition());
+			for (PointTree * cell = this; cell != leaf;) {
+				cell->offerLodSample(point, key);
+				cell = cell->findChild(point.getPosition());
+			}
+		}
+		return leaf->insertPoint(std::forward<PointRef_t>(point));
+	}
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+inline void PointTree<Point_t, value_t, dimension>::createChildren() {
+	// split every axis that is not shorter than the largest extent divided by sqrt(2) (see Helper::splitBoxCubeLike)
+	static const value_t isq2 = static_cast<value_t>(1) / std::sqrt(static_cast<value_t>(2));
+	const value_t threshold = getExtentMax() * isq2;
+	value_t min[dimension], center[dimension], max[dimension];
+	unsigned int splitAxes[dimension];
+	unsigned int splitCount = 0;
+	for (unsigned int axis = 0; axis < dimension; ++axis) {
+		min[axis] = traits_t::getMin(box, axis);
+		max[axis] = traits_t::getMax(box, axis);
+		center[axis] = (min[axis] + max[axis]) / 2;
+		if (!(threshold > max[axis] - min[axis])) {
+			splitAxes[splitCount++] = axis;
+		}
+	}
+	children.reserve(1u << splitCount);
+	for (unsigned int child = 0; child < (1u << splitCount); ++child) {
+		value_t childMin[dimension], childMax[dimension];
+		std::copy(min, min + dimension, childMin);
+		std::copy(max, max + dimension, childMax);
+		for (unsigned int i = 0; i < splitCount; ++i) {
+			const unsigned int axis = splitAxes[i];
+			if ((child >> i) & 1) {
+				childMin[axis] = center[axis];
+			} else {
+				childMax[axis] = center[axis];
+			}
+		}
+		children.emplace_back(traits_t::createBox(childMin, childMax), minBoxSize, maxNumPoints);
+		children.back().lodSampleCount = lodSampleCount;
+	}
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+inline void PointTree<Point_t, value_t, dimension>::split() {
+	createChildren();
+
+	// move existing points to new children; a point is only moved by the child accepting it
+	for (auto & currentPoint : points) {
+		for (auto & child : children) {
+			if (child.insertPoint(std::move(currentPoint))) {
+				break;
+			}
+		}
+	}
+	points.clear();
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+inline bool PointTree<Point_t, value_t, dimension>::update(const Point_t & oldPoint, const vec_t & newPosition) {
+	const vec_t oldPosition = oldPoint.getPosition();
+	if (!traits_t::contains(box, oldPosition) || !traits_t::contains(box, newPosition)) {
+		return false;
+	}
+	std::vector<PointTree *> path(1, this);
+	while (path.back()->hasChildren()) {
+		PointTree * next = path.back()->findChild(oldPosition);
+		if (next == nullptr) {
+			return false;
+		}
+		path.push_back(next);
+	}
+	PointTree * leaf = path.back();
+	const auto it = std::find(leaf->points.begin(), leaf->points.end(), oldPoint);
+	if (it == leaf->points.end()) {
+		return false;
+	}
+
+	if (lodSampleCount != 0) {
+		// the key of the point changes, so it may now belong to different samples; a point contributes at most one
+		// sample to a cell, so only the first equal one is erased and co-located points keep their samples
+		for (PointTree * cell : path) {
+			bool erased = false;
+			auto isOldPoint = [&oldPoint, &erased](const Point_t & p) {
+				if (erased || !(p == oldPoint)) {
+					return false;
+				}
+				erased = true;
+				return true;
+			};
+			cell->eraseLodSamplesIf(isOldPoint);
+		}
+	}
+
+	// climb to the lowest cell containing the new position
+	std::size_t ancestor = path.size() - 1;
+	while (!traits_t::contains(path[ancestor]->box, newPosition)) {
+		--ancestor;
+	}
+	const Point_t * moved;
+	if (ancestor == path.size() - 1) {
+		// the point stays inside of its leaf
+		it->setPosition(newPosition);
+		moved = &*it;
+	} else {
+		// the split of the new leaf and the merges above the old leaf are deferred until flushUpdates()
+		for (PointTree * cell : path) {
+			cell->updatesPending = true;
+		}
+		Point_t point(std::move(*it));
+		leaf->points.erase(it);
+		point.setPosition(newPosition);
+		path.resize(ancestor + 1);
+		while (path.back()->hasChildren()) {
+			path.push_back(path.back()->findChild(newPosition));
+			path.back()->updatesPending = true;
+		}
+		path.back()->points.push_back(std::move(point));
+		moved = &path.back()->points.back();
+	}
+	if (lodSampleCount != 0) {
+		const uint32_t key = getLodKey(newPosition);
+		for (PointTree * cell : path) {
+			cell->offerLodSample(*moved, key);
+		}
+	}
+	return true;
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+inline void PointTree<Point_t, value_t, dimension>::flushUpdates() {
+	if (!updatesPending) {
+		return;
+	}
+	updatesPending = false;
+	if (isLeaf()) {
+		if (needsSplit(points.size())) {
+			split();
+		}
+		return;
+	}
+	for (auto & child : children) {
+		child.flushUpdates();
+	}
+	mergeChildrenIfSmall();
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+inline void PointTree<Point_t, value_t, dimension>::offerLodSample(const Point_t & point, uint32_t key) {
+	if (lodSamples.size() >= lodSampleCount && key >= lodSamples.back().key) {
+		return;
+	}
+	// the samples are rebuilt, as points need not be assignable
+	std::vector<LodSample> newSamples;
+	newSamples.reserve(std::min<std::size_t>(lodSamples.size() + 1, lodSampleCount));
+	bool inserted = false;
+	for (const auto & sample : lodSamples) {
+		if (!inserted && key < sample.key) {
+			newSamples.emplace_back(key, point);
+			inserted = true;
+		}
+		if (newSamples.size() == lodSampleCount) {
+			break;
+		}
+		newSamples.push_back(sample);
+	}
+	if (!inserted && newSamples.size() < lodSampleCount) {
+		newSamples.emplace_back(key, point);
+	}
+	lodSamples.swap(newSamples);
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+inline void PointTree<Point_t, value_t, dimension>::calculateLodSamples() {
+	std::vector<LodSample>().swap(lodSamples);
+	for (auto & child : children) {
+		child.lodSampleCount = lodSampleCount;
+		child.calculateLodSamples();
+	}
+	if (lodSampleCount == 0) {
+		return;
+	}
+	// the smallest keys of the subtree are among the smallest keys of the children
+	std::vector<LodSample> candidates;
+	if (isLeaf()) {
+		for (const auto & p : points) {
+			candidates.emplace_back(getLodKey(p.getPosition()), p);
+		}
+	} else {
+		for (const auto & child : children) {
+			std::copy(child.lodSamples.begin(), child.lodSamples.end(), std::back_inserter(candidates));
+		}
+	}
+	std::vector<const LodSample *> order;
+	order.reserve(candidates.size());
+	for (const auto & candidate : candidates) {
+		order.push_back(&candidate);
+	}
+	std::stable_sort(order.begin(), order.end(),
+					 [](const LodSample * a, const LodSample * b) { return a->key < b->key; });
+	lodSamples.reserve(std::min<std::size_t>(order.size(), lodSampleCount));
+	for (std::size_t i = 0; i < order.size() && i < lodSampleCount; ++i) {
+		lodSamples.push_back(*order[i]);
+	}
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Iterator>
+bool PointTree<Point_t, value_t, dimension>::distributeRange(std::vector<Iterator> & source,
+															 std::vector<Iterator> & target,
+															 std::vector<uint8_t> & childSlots, std::size_t begin,
+															 std::size_t end, std::size_t (&childBegin)[maxChildCount],
+															 std::size_t (&childEnd)[maxChildCount]) {
+	// same split criterion as insert(): more than maxNumPoints points in a large enough cell
+	if (!needsSplit(end - begin)) {
+		for (std::size_t i = begin; i < end; ++i) {
+			points.push_back(*source[i]);
+		}
+		return false;
+	}
+	createChildren();
+
+	// assign every point to the first child containing it (like insert()); points outside of all children are dropped
+	static const uint8_t noChild = 0xff;
+	std::size_t counts[maxChildCount] = {0};
+	for (std::size_t i = begin; i < end; ++i) {
+		const vec_t & pos = (*source[i]).getPosition();
+		childSlots[i] = noChild;
+		for (uint8_t c = 0; c < children.size(); ++c) {
+			if (traits_t::contains(children[c].box, pos)) {
+				childSlots[i] = c;
+				++counts[c];
+				break;
+			}
+		}
+	}
+	std::size_t offset = begin;
+	for (std::size_t c = 0; c < children.size(); ++c) {
+		childBegin[c] = childEnd[c] = offset;
+		offset += counts[c];
+	}
+
+	// stable counting sort into the target buffer
+	for (std::size_t i = begin; i < end; ++i) {
+		if (childSlots[i] != noChild) {
+			target[childEnd[childSlots[i]]++] = source[i];
+		}
+	}
+	return true;
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Iterator>
+void PointTree<Point_t, value_t, dimension>::buildFromRange(std::vector<Iterator> & source,
+															std::vector<Iterator> & target,
+															std::vector<uint8_t> & childSlots, std::size_t begin,
+															std::size_t end) {
+	std::size_t childBegin[maxChildCount];
+	std::size_t childEnd[maxChildCount];
+	if (distributeRange(source, target, childSlots, begin, end, childBegin, childEnd)) {
+		for (std::size_t c = 0; c < children.size(); ++c) {
+			children[c].buildFromRange(target, source, childSlots, childBegin[c], childEnd[c]);
+		}
+	}
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Iterator>
+void PointTree<Point_t, value_t, dimension>::buildFromRangeParallel(std::vector<Iterator> & source,
+																	std::vector<Iterator> & target,
+																	std::vector<uint8_t> & childSlots,
+																	unsigned int numThreads,
+																	std::size_t sequentialCutoff) {
+	struct Task {
+		PointTree * cell;
+		std::vector<Iterator> * source;
+		std::vector<Iterator> * target;
+		std::size_t begin;
+		std::size_t end;
+	};
+	// Tasks work on disjoint ranges of the shared buffers and on disjoint subtrees.
+	std::deque<Task> tasks;
+	std::size_t pendingTasks = 1;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::exception_ptr error; //!< First exception thrown by a task; the remaining tasks are dropped.
+	bool stopped = false;
+	tasks.push_back({this, &source, &target, 0, source.size()});
+
+	auto worker = [&]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			condition.wait(lock, [&]() { return stopped || !tasks.empty() || pendingTasks == 0; });
+			if (stopped || tasks.empty()) {
+				return;
+			}
+			const Task task = tasks.front();
+			tasks.pop_front();
+			lock.unlock();
+
+			std::size_t childBegin[maxChildCount];
+			std::size_t childEnd[maxChildCount];
+			bool hasChildTasks = false;
+			try {
+				if (task.end - task.begin <= sequentialCutoff) {
+					task.cell->buildFromRange(*task.source, *task.target, childSlots, task.begin, task.end);
+				} else {
+					hasChildTasks = task.cell->distributeRange(*task.source, *task.target, childSlots, task.begin,
+															   task.end, childBegin, childEnd);
+				}
+			} catch (...) {
+				lock.lock();
+				if (!error) {
+					error = std::current_exception();
+				}
+				stopped = true;
+				condition.notify_all();
+				return;
+			}
+
+			lock.lock();
+			if (hasChildTasks) {
+				for (std::size_t c = 0; c < task.cell->children.size(); ++c) {
+					tasks.push_back({&task.cell->children[c], task.target, task.source, childBegin[c], childEnd[c]});
+				}
+				pendingTasks += task.cell->children.size();
+			}
+			--pendingTasks;
+			condition.notify_all();
+		}
+	};
+
+	//! Stops and joins the threads when leaving the scope, also if starting a thread fails.
+	struct ThreadGuard {
+		std::vector<std::thread> threads;
+		std::mutex & mutex;
+		std::condition_variable & condition;
+		bool & stopped;
+
+		~ThreadGuard() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopped = true;
+			}
+			condition.notify_all();
+			for (auto & thread : threads) {
+				thread.join();
+			}
+		}
+	};
+
+	if (numThreads == 0) {
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	{
+		ThreadGuard guard{{}, mutex, condition, stopped};
+		for (unsigned int i = 1; i < numThreads; ++i) {
+			guard.threads.emplace_back(worker);
+		}
+		worker();
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Predicate_t>
+inline std::size_t PointTree<Point_t, value_t, dimension>::erasePointsIf(Predicate_t & predicate, std::true_type) {
+	const auto newEnd = std::remove_if(points.begin(), points.end(), std::ref(predicate));
+	const std::size_t removed = static_cast<std::size_t>(std::distance(newEnd, points.end()));
+	points.erase(newEnd, points.end());
+	return removed;
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Predicate_t>
+inline std::size_t PointTree<Point_t, value_t, dimension>::erasePointsIf(Predicate_t & predicate, std::false_type) {
+	// points cannot be assigned; move the remaining ones into a new container if something has to be removed
+	auto it = std::find_if(points.begin(), points.end(), std::ref(predicate));
+	if (it == points.end()) {
+		return 0;
+	}
+	std::deque<Point_t> remainingPoints;
+	for (auto & p : points) {
+		if (!predicate(p)) {
+			remainingPoints.push_back(std::move(p));
+		}
+	}
+	const std::size_t removed = points.size() - remainingPoints.size();
+	points.swap(remainingPoints);
+	return removed;
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+inline bool PointTree<Point_t, value_t, dimension>::mergeChildrenIfSmall() {
+	std::size_t count = 0;
+	for (const auto & child : children) {
+		if (child.hasChildren()) {
+			return false;
+		}
+		count += child.points.size();
+	}
+	if (count >= maxNumPoints) {
+		return false;
+	}
+	for (auto & child : children) {
+		for (auto & p : child.points) {
+			points.push_back(std::move(p));
+		}
+	}
+	children.clear();
+	return true;
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+inline bool PointTree<Point_t, value_t, dimension>::remove(const Point_t & point) {
+	const vec_t position = point.getPosition();
+	// make sure point is within boundary
+	if (!traits_t::contains(box, position)) {
+		return false;
+	}
+	std::vector<PointTree *> path;
+	PointTree * cell = this;
+	while (cell->hasChildren()) {
+		path.push_back(cell);
+		cell = cell->findChild(position);
+		if (cell == nullptr) {
+			return false;
+		}
+	}
+	auto isAtPosition = [&position](const Point_t & p) { return p.getPosition() == position; };
+	if (cell->erasePointsIf(isAtPosition, std::is_move_assignable<Point_t>()) == 0) {
+		return false;
+	}
+	if (lodSampleCount != 0) {
+		for (PointTree * pathCell : path) {
+			pathCell->eraseLodSamplesIf(isAtPosition);
+		}
+		cell->eraseLodSamplesIf(isAtPosition);
+	}
+	// merge the leaves bottom-up as long as the parent's points fit into a single leaf
+	while (!path.empty() && path.back()->mergeChildrenIfSmall()) {
+		path.pop_back();
+	}
+	return true;
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Predicate_t>
+inline std::size_t PointTree<Point_t, value_t, dimension>::removeIfWithin(Predicate_t & predicate,
+																		  const box_t & region) {
+	if (!traits_t::intersects(box, region)) {
+		return 0;
+	}
+	auto isSelected = [&](const Point_t & p) { return traits_t::contains(region, p.getPosition()) && predicate(p); };
+	std::size_t removed = 0;
+	if (isLeaf()) {
+		removed = traits_t::contains(region, box) ? erasePointsIf(predicate, std::is_move_assignable<Point_t>())
+												  : erasePointsIf(isSelected, std::is_move_assignable<Point_t>());
+	} else {
+		for (auto & child : children) {
+			removed += child.removeIfWithin(predicate, region);
+		}
+	}
+	if (removed > 0) {
+		eraseLodSamplesIf(isSelected);
+		if (hasChildren()) {
+			mergeChildrenIfSmall();
+		}
+	}
+	return removed;
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Visitor_t, typename Counters_t>
+inline bool PointTree<Point_t, value_t, dimension>::visitSubtree(const PointTree * subtree, Visitor_t & visitor,
+																 traversal_stack_t & activeCells,
+																 Counters_t & counters) {
+	// use the upper part of the given stack; the entries below 'base' belong to the caller
+	const std::size_t base = activeCells.size();
+	activeCells.push_back(subtree);
+	while (activeCells.size() > base) {
+		const PointTree * cell = activeCells.back();
+		activeCells.pop_back();
+		if (cell != subtree) { // the root of the subtree has been counted by the caller
+			counters.countNode();
+		}
+		if (cell->hasChildren()) {
+			for (const auto & child : cell->children) {
+				activeCells.push_back(&child);
+			}
+		} else {
+			for (const auto & p : cell->points) {
+				counters.countResult();
+				if (!visitor(p)) {
+					activeCells.resize(base);
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Visitor_t, typename Counters_t>
+inline bool PointTree<Point_t, value_t, dimension>::visitPointsWithinBox(const box_t & queryBox, Visitor_t && visitor,
+																		 traversal_stack_t & activeCells,
+																		 Counters_t & counters) const {
+	activeCells.clear();
+	activeCells.push_back(this);
+	while (!activeCells.empty()) {
+		const PointTree * cell = activeCells.back();
+		activeCells.pop_back();
+		counters.countNode();
+		counters.countBox();
+
+		if (!traits_t::intersects(cell->box, queryBox)) {
+			continue;
+		} else if (traits_t::contains(queryBox, cell->box)) {
+			if (!visitSubtree(cell, visitor, activeCells, counters)) {
+				activeCells.clear();
+				return false;
+			}
+		} else if (cell->hasChildren()) {
+			for (const auto & child : cell->children) {
+				activeCells.push_back(&child);
+			}
+		} else {
+			for (const auto & p : cell->points) {
+				counters.countPoint();
+				if (!traits_t::contains(queryBox, p.getPosition())) {
+					continue;
+				}
+				counters.countResult();
+				if (!visitor(p)) {
+					activeCells.clear();
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Visitor_t, typename Counters_t>
+inline bool PointTree<Point_t, value_t, dimension>::visitPointsWithinRadius(const vec_t & center, value_t radius,
+																			Visitor_t && visitor,
+																			traversal_stack_t & activeCells,
+																			Counters_t & counters) const {
+	activeCells.clear();
+	activeCells.push_back(this);
+	const value_t radiusSquared = radius * radius;
+	while (!activeCells.empty()) {
+		const PointTree * cell = activeCells.back();
+		activeCells.pop_back();
+		counters.countNode();
+		counters.countBox();
+
+		if (traits_t::getDistanceSquared(cell->box, center) > radiusSquared) {
+			continue;
+		} else if (cell->getMaxDistanceSquared(center) <= radiusSquared) {
+			// the whole cell is inside of the sphere
+			if (!visitSubtree(cell, visitor, activeCells, counters)) {
+				activeCells.clear();
+				return false;
+			}
+		} else if (cell->hasChildren()) {
+			for (const auto & child : cell->children) {
+				activeCells.push_back(&child);
+			}
+		} else {
+			for (const auto & p : cell->points) {
+				counters.countPoint();
+				if (center.distanceSquared(p.getPosition()) > radiusSquared) {
+					continue;
+				}
+				counters.countResult();
+				if (!visitor(p)) {
+					activeCells.clear();
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+inline void PointTree<Point_t, value_t, dimension>::collectStatistics(Statistics & statistics,
+																	  std::size_t depth) const {
+	++statistics.nodeCount;
+	if (statistics.depthHistogram.size() <= depth) {
+		statistics.depthHistogram.resize(depth + 1, 0);
+	}
+	++statistics.depthHistogram[depth];
+	// the cell object itself is counted by its parent's children array or by getStatistics() for the root
+	statistics.memoryFootprint += children.capacity() * sizeof(PointTree) + points.size() * sizeof(Point_t)
+								  + lodSamples.capacity() * sizeof(LodSample);
+	if (isLeaf()) {
+		++statistics.leafCount;
+		statistics.pointCount += points.size();
+		if (statistics.leafOccupancyHistogram.size() <= points.size()) {
+			statistics.leafOccupancyHistogram.resize(points.size() + 1, 0);
+		}
+		++statistics.leafOccupancyHistogram[points.size()];
+	}
+	for (const auto & child : children) {
+		child.collectStatistics(statistics, depth + 1);
+	}
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Counters_t>
+inline void PointTree<Point_t, value_t, dimension>::findClosestPoints(
+		const vec_t & pos, uint64_t count, value_t epsilon, std::vector<std::pair<value_t, const Point_t *>> & result,
+		Counters_t & counters) const {
+	typedef std::pair<value_t, const PointTree *> cellEntry_t;
+	typedef std::pair<value_t, const Point_t *> pointEntry_t;
+	struct FartherFirst {
+		bool operator()(const cellEntry_t & a, const cellEntry_t & b) const {
+			return a.first > b.first;
+		}
+	};
+	struct CloserFirst {
+		bool operator()(const pointEntry_t & a, const pointEntry_t & b) const {
+			return a.first < b.first;
+		}
+	};
+	result.clear();
+	if (count == 0) {
+		return;
+	}
+	// cell distances are scaled by (1 + epsilon)^2 before they are compared to the squared point distances
+	const value_t pruneFactor = (1 + epsilon) * (1 + epsilon);
+	// cells ordered by their distance to pos; result is a max-heap holding the best candidates found so far
+	std::priority_queue<cellEntry_t, std::vector<cellEntry_t>, FartherFirst> activeCells;
+	counters.countBox();
+	activeCells.emplace(traits_t::getDistanceSquared(box, pos), this);
+	while (!activeCells.empty()) {
+		const cellEntry_t entry = activeCells.top();
+		activeCells.pop();
+		if (result.size() == count && entry.first * pruneFactor > result.front().first) {
+			break; // all remaining cells are farther away than the current k-th point
+		}
+		counters.countNode();
+		const PointTree * cell = entry.second;
+		if (cell->isLeaf()) {
+			for (const auto & p : cell->points) {
+				counters.countPoint();
+				const value_t distSquared = pos.distanceSquared(p.getPosition());
+				if (result.size() < count) {
+					result.emplace_back(distSquared, &p);
+					std::push_heap(result.begin(), result.end(), CloserFirst());
+				} else if (distSquared < result.front().first) {
+					std::pop_heap(result.begin(), result.end(), CloserFirst());
+					result.back() = pointEntry_t(distSquared, &p);
+					std::push_heap(result.begin(), result.end(), CloserFirst());
+				}
+			}
+		} else {
+			for (const auto & child : cell->children) {
+				counters.countBox();
+				const value_t distSquared = traits_t::getDistanceSquared(child.box, pos);
+				if (result.size() < count || distSquared * pruneFactor <= result.front().first) {
+					activeCells.emplace(distSquared, &child);
+				}
+			}
+		}
+	}
+	std::sort_heap(result.begin(), result.end(), CloserFirst());
+	counters.countResult(result.size());
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Counters_t>
+inline void PointTree<Point_t, value_t, dimension>::getClosestPoints(const vec_t & pos, uint64_t count,
+																	 std::deque<Point_t> & out,
+																	 Counters_t & counters) const {
+	if (!traits_t::contains(box, pos)) {
+		return;
+	}
+	std::vector<std::pair<value_t, const Point_t *>> closestPoints;
+	findClosestPoints(pos, count, 0, closestPoints, counters);
+	out.clear();
+	for (const auto & distancePointPair : closestPoints) {
+		out.push_back(*distancePointPair.second);
+	}
+}
+
+template <typename Point_t, typename value_t, unsigned int dimension>
+template <typename Counters_t>
+inline void PointTree<Point_t, value_t, dimension>::getApproximateClosestPoints(const vec_t & pos, uint64_t count,
+																				value_t epsilon,
+																				std::deque<Point_t> & out,
+																				Counters_t & counters) const {
+	if (!(epsilon >= 0)) {
+		throw std::invalid_argument("PointTree: epsilon must not be negative");
+	}
+	if (!traits_t::contains(box, pos)) {
+		return;
+	}
+	std::vector<std::pair<value_t, const Point_t *>> closestPoints;
+	findClosestPoints(pos, count, epsilon, closestPoints, counters);
+	out.clear();
+	for (const auto & distancePointPair : closestPoints) {
+		out.push_back(*distancePointPair.second);
+	}
+}
+
+template <typename Point_t>
+template <typename Line_t, typename Visitor_t>
+inline bool PointTreeQueries<Point_t, float, 3>::visitPointsNearLine(const Line_t & line, float radius,
+																	 Visitor_t & visitor,
+																	 traversal_stack_t & activeCells) const {
+	if (!(line.getMaxParam() > 0.0f)) {
+		// degenerated segment without direction
+		return getTree().visitPointsWithinRadius(line.getOrigin(), radius, visitor, activeCells);
+	}
+	const Intersection::Slope<float> slope(Ray3f(line.getOrigin(), line.getDirection()));
+	const float radiusSquared = radius * radius;
+	activeCells.clear();
+	activeCells.push_back(&getTree());
+	while (!activeCells.empty()) {
+		const tree_t * cell = activeCells.back();
+		activeCells.pop_back();
+
+		Box enlargedBox(cell->box);
+		enlargedBox.resizeAbs(radius);
+		float entry;
+		if (!slope.getRayBoxIntersection(enlargedBox, entry) || entry > line.getMaxParam()) {
+			continue;
+		} else if (cell->hasChildren()) {
+			for (const auto & child : cell->children) {
+				activeCells.push_back(&child);
+			}
+		} else {
+			for (const auto & p : cell->points) {
+				float param;
+				if (getLineDistanceSquared(line, p.getPosition(), param) <= radiusSquared && !visitor(p)) {
+					activeCells.clear();
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+template <typename Point_t>
+template <typename Line_t>
+inline const Point_t * PointTreeQueries<Point_t, float, 3>::findFirstPointAlongLine(const Line_t & line,
+																					float radius) const {
+	if (!(line.getMaxParam() > 0.0f)) {
+		// degenerated segment: every point near its origin is hit at parameter zero
+		const Point_t * first = nullptr;
+		getTree().visitPointsWithinRadius(line.getOrigin(), radius, [&first](const Point_t & p) {
+			first = &p;
+			return false;
+		});
+		return first;
+	}
+	typedef std::pair<float, const tree_t *> cellEntry_t;
+	struct FartherFirst {
+		bool operator()(const cellEntry_t & a, const cellEntry_t & b) const {
+			return a.first > b.first;
+		}
+	};
+	const Intersection::Slope<float> slope(Ray3f(line.getOrigin(), line.getDirection()));
+	const float radiusSquared = radius * radius;
+	const Point_t * first = nullptr;
+	float firstParam = line.getMaxParam();
+
+	// The entry parameter into the enlarged box of a cell is a lower bound for the parameter of every hit inside.
+	const auto getEntry = [&](const tree_t & cell, float & entry) {
+		Box enlargedBox(cell.box);
+		enlargedBox.resizeAbs(radius);
+		if (!slope.getRayBoxIntersection(enlargedBox, entry)) {
+			return false;
+		}
+		entry = std::max(entry, 0.0f);
+		return entry <= firstParam;
+	};
+	std::priority_queue<cellEntry_t, std::vector<cellEntry_t>, FartherFirst> activeCells;
+	float entry;
+	if (getEntry(getTree(), entry)) {
+		activeCells.emplace(entry, &getTree());
+	}
+	while (!activeCells.empty()) {
+		const cellEntry_t cellEntry = activeCells.top();
+		activeCells.pop();
+		if (cellEntry.first > firstParam) {
+			break; // all remaining cells are behind the current hit
+		}
+		const tree_t * cell = cellEntry.second;
+		if (cell->isLeaf()) {
+			for (const auto & p : cell->points) {
+				float param;
+				if (getLineDistanceSquared(line, p.getPosition(), param) <= radiusSquared
+					&& (first == nullptr || param < firstParam)) {
+					first = &p;
+					firstParam = param;
+				}
+			}
+		} else {
+			for (const auto & child : cell->children) {
+				if (getEntry(child, entry)) {
+					activeCells.emplace(entry, &child);
+				}
+			}
+		}
+	}
+	return first;
+}
+
+template <typename Point_t>
+template <typename Visitor_t>
+inline bool PointTreeQueries<Point_t, float, 3>::visitCellWithinFrustum(const tree_t & cell, const Frustum & frustum,
+																		uint8_t planeMask, Visitor_t & visitor,
+																		traversal_stack_t & activeCells) {
+	switch (frustum.isBoxInFrustum(cell.box, planeMask)) {
+		case Frustum::intersection_t::OUTSIDE:
+			return true;
+		case Frustum::intersection_t::INSIDE:
+			return tree_t::visitSubtree(&cell, visitor, activeCells);
+		case Frustum::intersection_t::INTERSECT:
+		default:
+			break;
+	}
+	if (cell.hasChildren()) {
+		for (const auto & child : cell.children) {
+			if (!visitCellWithinFrustum(child, frustum, planeMask, visitor, activeCells)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	for (const auto & p : cell.points) {
+		if (isInsidePlanes(frustum, planeMask, p.getPosition()) && !visitor(p)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename Point_t>
+template <typename Visitor_t>
+inline bool PointTreeQueries<Point_t, float, 3>::visitPointsLOD(const Box & queryBox, float maxError,
+																Visitor_t && visitor,
+																traversal_stack_t & activeCells) const {
+	activeCells.clear();
+	activeCells.push_back(&getTree());
+	while (!activeCells.empty()) {
+		const tree_t * cell = activeCells.back();
+		activeCells.pop_back();
+
+		if (!tree_t::traits_t::intersects(cell->box, queryBox)) {
+			continue;
+		} else if (cell->lodSampleCount != 0 && cell->box.getExtentMax() <= maxError) {
+			for (const auto & sample : cell->lodSamples) {
+				if (queryBox.contains(sample.point.getPosition()) && !visitor(sample.point)) {
+					activeCells.clear();
+					return false;
+				}
+			}
+		} else if (cell->hasChildren()) {
+			for (const auto & child : cell->children) {
+				activeCells.push_back(&child);
+			}
+		} else {
+			for (const auto & p : cell->points) {
+				if (queryBox.contains(p.getPosition()) && !visitor(p)) {
+					activeCells.clear();
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+template <typename Point_t>
+template <typename Visitor_t>
+inline bool PointTreeQueries<Point_t, float, 3>::visitCellLOD(const tree_t & cell, const Frustum & frustum,
+															  uint8_t planeMask, float maxError, Visitor_t & visitor,
+															  traversal_stack_t & activeCells) {
+	if (frustum.isBoxInFrustum(cell.box, planeMask) == Frustum::intersection_t::OUTSIDE) {
+		return true;
+	}
+	if (cell.lodSampleCount != 0) {
+		float error = cell.box.getExtentMax();
+		if (!frustum.isOrthogonal()) {
+			const float distance = std::sqrt(cell.box.getDistanceSquared(frustum.getPos()));
+			error = distance > 0.0f ? error / distance : std::numeric_limits<float>::infinity();
+		}
+		if (error <= maxError) {
+			for (const auto & sample : cell.lodSamples) {
+				if (isInsidePlanes(frustum, planeMask, sample.point.getPosition()) && !visitor(sample.point)) {
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+	if (cell.hasChildren()) {
+		for (const auto & child : cell.children) {
+			if (!visitCellLOD(child, frustum, planeMask, maxError, visitor, activeCells)) {
+				return false;
+			}
+		}
+		return true;
+	} else if (planeMask == 0) {
+		return tree_t::visitSubtree(&cell, visitor, activeCells);
+	}
+	for (const auto & p : cell.points) {
+		if (isInsidePlanes(frustum, planeMask, p.getPosition()) && !visitor(p)) {
+			return false;
+		}
+	}
+	return true;
+}
+}
+
+#endif /* GEOMETRY_POINTTREE_H */
@@ -11,11 +11,24 @@
 
 #include "Box.h"
 #include "BoxIntersection.h"
+#include "Line.h"
 #include "Vec3.h"
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <mutex>
 #include <stack>
+#include <new>
+#include <stdexcept>
 #include <tuple>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <memory>
 
@@ -26,6 +39,8 @@ namespace Geometry {
 	 - the root node is adjusted automatically
 	 - empty inner nodes are skipped
 	 - subtrees having an uniform value are represented by single nodes
+	 - areas, children arrays and blocks are allocated from per-storage pools, so that released nodes are reused and
+	   the whole tree can be released at once
 
 	\todo levels should only be skipped if the value is nullVoxel. Serialization should be easier then.
 */
@@ -48,6 +63,85 @@ public:
 
 	// ------------
 private:
+	/*! Slab allocator for objects of type T.
+		Memory is allocated in slabs of several objects; destroyed objects are kept in a free list for reuse.
+		release() frees all slabs at once without calling any destructors.
+	*/
+	template <typename T>
+	class Pool {
+		union Slot {
+			Slot * next;
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type object;
+		};
+		static const size_t slabSize = sizeof(T) < 1024 ? 65536 / sizeof(T) : 64;
+
+		std::vector<std::unique_ptr<Slot[]>> slabs;
+		Slot * freeList;
+		size_t slabUsed; //!< Number of slots handed out from the last slab
+
+		void destroySlot(Slot * slot) {
+			slot->next = freeList;
+			freeList = slot;
+		}
+
+	public:
+		Pool() : freeList(nullptr), slabUsed(slabSize) {
+		}
+		Pool(Pool && other) : slabs(std::move(other.slabs)), freeList(other.freeList), slabUsed(other.slabUsed) {
+			other.release();
+		}
+
+		template <typename... Args_t>
+		T * create(Args_t &&... args) {
+			Slot * slot;
+			if (freeList) {
+				slot = freeList;
+				freeList = slot->next;
+			} else {
+				if (slabUsed == slabSize) {
+					slabs.emplace_back(new Slot[slabSize]);
+					slabUsed = 0;
+				}
+				slot = &slabs.back()[slabUsed++];
+			}
+			return new (&slot->object) T(std::forward<Args_t>(args)...);
+		}
+		void destroy(T * object) {
+			object->~T();
+			destroySlot(reinterpret_cast<Slot *>(object));
+		}
+		void release() {
+			slabs.clear();
+			freeList = nullptr;
+			slabUsed = slabSize;
+		}
+		//! Take over the slabs and the free objects of @p other.
+		void merge(Pool && other) {
+			if (other.slabs.empty())
+				return;
+			for (size_t i = other.slabUsed; i < slabSize; ++i)
+				destroySlot(&other.slabs.back()[i]);
+			while (other.freeList) {
+				Slot * slot = other.freeList;
+				other.freeList = slot->next;
+				destroySlot(slot);
+			}
+			if (slabs.empty()) {
+				slabs = std::move(other.slabs);
+				slabUsed = slabSize;
+			} else { // keep the partially used slab at the end
+				slabs.insert(slabs.end() - 1, std::make_move_iterator(other.slabs.begin()),
+							 std::make_move_iterator(other.slabs.end()));
+			}
+			other.release();
+		}
+		size_t getMemoryUsage() const {
+			return slabs.size() * slabSize * sizeof(Slot);
+		}
+	};
+	struct Area;
+	struct Pools;
+
 	struct Area {
 		const Vec3_t origin;
 		const uinteger_t sideLength;
@@ -65,16 +159,19 @@ private:
 				: origin(_origin),
 				  sideLength(_sideLength),
 				  dataType(DataType::UNIFORM_AREA),
+				  markedForConsolidation(false),
 				  uniformValue(_uniformValue) {
 		}
-		~Area() {
-			clear();
-		}
-		void clear() {
+		//! Release the children (recursively) or the block.
+		void clear(Pools & pools) {
 			if (isContainer()) {
-				delete data.children;
+				for (auto child : *data.children) {
+					if (child)
+						pools.destroyArea(child);
+				}
+				pools.children.destroy(data.children);
 			} else if (isBlock()) {
-				delete data.block;
+				pools.blocks.destroy(data.block);
 			}
 			dataType = DataType::UNIFORM_AREA;
 		}
@@ -127,54 +224,78 @@ private:
 			return Box_t(origin, origin + Vec3_t(sideLength - 1, sideLength - 1, sideLength - 1));
 		}
 
-		std::array<Area *, 8> & assureContainer() {
+		std::array<Area *, 8> & assureContainer(Pools & pools) {
 			if (!isContainer()) {
 				assert(sideLength > blockSideLength);
-				clear();
-				data.children = new std::array<Area *, 8>;
-				for (auto & c : *data.children)
-					c = nullptr;
+				clear(pools);
+				data.children = pools.children.create();
+				data.children->fill(nullptr);
 				dataType = DataType::CONTAINER;
 			}
 			return *data.children;
 		}
-		block_t & assureBlock() {
+		block_t & assureBlock(Pools & pools) {
 			if (!isBlock()) {
 				assert(sideLength == blockSideLength);
-				clear();
-				data.block = new block_t;
-				for (auto & v : *data.block)
-					v = uniformValue;
+				clear(pools);
+				data.block = pools.blocks.create();
+				data.block->fill(uniformValue);
 				dataType = DataType::BLOCK;
 			}
 			return *data.block;
 		}
-		void convertToUniformArea(const Voxel_t & _uniformValue) {
-			clear();
+		void convertToUniformArea(Pools & pools, const Voxel_t & _uniformValue) {
+			clear(pools);
 			uniformValue = _uniformValue;
 			markedForConsolidation = false;
 		}
-		Area * insertIntermediateChild(const Vec3_t _origin, uinteger_t _sideLength) {
+		Area * insertIntermediateChild(Pools & pools, const Vec3_t _origin, uinteger_t _sideLength) {
 			assert(_sideLength < sideLength);
 			assert(contains(_origin));
-			auto & children = assureContainer();
+			auto & children = assureContainer(pools);
 			const uint8_t childIndex = getChildIndex(_origin);
-			Area * newChild = new Area(_origin, _sideLength, uniformValue);
+			Area * newChild = pools.areas.create(_origin, _sideLength, uniformValue);
 			Area * oldChild = children[childIndex];
 			children[childIndex] = newChild;
 			if (oldChild) {
 				assert(oldChild->sideLength < _sideLength);
-				auto & children2 = newChild->assureContainer();
+				auto & children2 = newChild->assureContainer(pools);
 				children2[newChild->getChildIndex(oldChild->origin)] = oldChild;
 			}
 			return newChild;
 		}
-		void setChild(uint8_t i, Area * child) {
-			assureContainer();
+		void setChild(Pools & pools, uint8_t i, Area * child) {
+			assureContainer(pools);
 			assert(data.children->at(i) == nullptr);
 			data.children->at(i) = child;
 		}
 	};
+	struct Pools {
+		Pool<Area> areas;
+		Pool<std::array<Area *, 8>> children;
+		Pool<block_t> blocks;
+
+		Pools() = default;
+		Pools(Pools && other)
+				: areas(std::move(other.areas)), children(std::move(other.children)), blocks(std::move(other.blocks)) {
+		}
+		//! Release @p area together with its subtree.
+		void destroyArea(Area * area) {
+			area->clear(*this);
+			areas.destroy(area);
+		}
+		//! Free all memory at once; Voxel_t destructors are not called.
+		void release() {
+			areas.release();
+			children.release();
+			blocks.release();
+		}
+		void merge(Pools && other) {
+			areas.merge(std::move(other.areas));
+			children.merge(std::move(other.children));
+			blocks.merge(std::move(other.blocks));
+		}
+	};
 	uint32_t posToBlockIdx(const Vec3_t & pos) const {
 		return (pos.x() & blockMask) + (pos.y() & blockMask) * blockSideLength
 				+ (pos.z() & blockMask) * blockSideLength * blockSideLength;
@@ -184,7 +305,10 @@ private:
 		return Vec3_t(pos.x() & areaMask, pos.y() & areaMask, pos.z() & areaMask);
 	}
 
-	std::unique_ptr<Area> root;
+	Pools pools;
+	Area * root;
+	//! Incremented whenever areas may have been removed or consolidation marks reset; validates Accessor caches.
+	uint32_t revision;
 
 	std::pair<Vec3_t, integer_t> getEnclosingAreaBox(const Area & area, const Vec3_t & pos) const {
 		Vec3_t newOrigin = area.getOrigin();
@@ -210,34 +334,43 @@ private:
 		return std::make_pair(origin, sideLength);
 	}
 
-	block_t & findOrCreateBlock(const Vec3_t & pos) {
+	//! Assure that the root exists and contains @p pos.
+	Area * assureRoot(const Vec3_t & pos) {
 		//			std::cout << "findOrCreateBlock("<<pos<<")"<<std::endl;
 		if (!root) {
-			root.reset(new Area(calcOrigin(pos, blockSideLength), blockSideLength, nullVoxel));
+			root = pools.areas.create(calcOrigin(pos, blockSideLength), blockSideLength, nullVoxel);
 			//				std::cout << "creating root: "<<root->origin<<std::endl;
 		}
 
 		if (!root->contains(pos)) {
-			const auto commonBox = getEnclosingAreaBox(*root.get(), pos);
+			const auto commonBox = getEnclosingAreaBox(*root, pos);
 			//				std::cout << "resetting root: "<<commonBox.first<<" : "<<commonBox.second<<std::endl;
-			Area * newRoot = new Area(commonBox.first, commonBox.second, nullVoxel);
-			Area * oldRoot = root.release();
-			newRoot->setChild(newRoot->getChildIndex(oldRoot->getOrigin()), oldRoot);
-			root.reset(newRoot);
+			Area * newRoot = pools.areas.create(commonBox.first, commonBox.second, nullVoxel);
+			newRoot->setChild(pools, newRoot->getChildIndex(root->getOrigin()), root);
+			root = newRoot;
 		}
+		return root;
+	}
 
-		Area * currentArea = root.get();
+	block_t & findOrCreateBlock(const Vec3_t & pos) {
+		return findOrCreateBlock(assureRoot(pos), pos, nullptr);
+	}
 
+	/*! Descend from @p currentArea, which has to contain @p pos, to the block containing @p pos and create missing
+		areas on the way. All visited areas are marked for consolidation. If @p path is given, the visited areas below
+		@p currentArea are appended to it.
+	*/
+	block_t & findOrCreateBlock(Area * currentArea, const Vec3_t & pos, std::vector<Area *> * path) {
 		while (true) {
 			//				std::cout << " >("<<currentArea->origin<<" : "<<currentArea->sideLength<< ")"<<std::endl;
 			currentArea->markedForConsolidation = true;
 			if (currentArea->isBlock()) {
-				return currentArea->assureBlock();
+				return *currentArea->getBlock();
 			} else if (currentArea->isContainer()) {
 				Area * child = currentArea->getChild(currentArea->getChildIndex(pos));
 				if (!child) {
-					currentArea =
-							currentArea->insertIntermediateChild(calcOrigin(pos, blockSideLength), blockSideLength);
+					currentArea = currentArea->insertIntermediateChild(pools, calcOrigin(pos, blockSideLength),
+																	   blockSideLength);
 				} else if (child->contains(pos)) {
 					currentArea = child;
 				} else { // insert intermediate area
@@ -250,30 +383,37 @@ private:
 					//						std::cout << "commonBox:"<< commonBox.first<<":"<<commonBox.second <<"
 					//"<<std::endl;
 
-					currentArea = currentArea->insertIntermediateChild(commonBox.first, commonBox.second);
+					currentArea = currentArea->insertIntermediateChild(pools, commonBox.first, commonBox.second);
 				}
 			} else { // if(currentArea->isUniform()){
 				if (currentArea->sideLength == blockSideLength) {
-					return currentArea->assureBlock();
+					return currentArea->assureBlock(pools);
 				} else {
-					currentArea =
-							currentArea->insertIntermediateChild(calcOrigin(pos, blockSideLength), blockSideLength);
+					currentArea = currentArea->insertIntermediateChild(pools, calcOrigin(pos, blockSideLength),
+																	   blockSideLength);
 				}
 			}
+			if (path)
+				path->push_back(currentArea);
 		}
 	}
-	void consolidate(Area * area) {
+	void consolidateFrom(Area * area) {
+		++revision;
+		consolidateSubtree(area, pools);
+	}
+	//! Combine the uniform subtrees below @p area that are marked for consolidation.
+	void consolidateSubtree(Area * area, Pools & areaPools) {
 		if (area && area->markedForConsolidation) {
 			area->markedForConsolidation = false;
 
 			if (area->isBlock()) {
-				const auto & block = area->assureBlock();
+				const auto & block = *area->getBlock();
 				Voxel_t value = block[0];
 				for (uint32_t j = 1; j < blockSize; ++j) {
 					if (block[j] != value)
 						return; // simplification not possible
 				}
-				area->convertToUniformArea(value);
+				area->convertToUniformArea(areaPools, value);
 			} else if (area->isContainer()) {
 				Voxel_t value = area->uniformValue;
 				bool childrenAreUniform = true;
@@ -281,7 +421,7 @@ private:
 				for (uint8_t i = 0; i < 8; ++i) {
 					Area * child = area->getChild(i);
 					if (child && child->markedForConsolidation)
-						consolidate(child);
+						consolidateSubtree(child, areaPools);
 					if (i == 0) { // first child
 						if (child) {
 							if (child->isUniform()) {
@@ -299,65 +439,28 @@ private:
 					}
 				}
 				if (childrenAreUniform) {
-					area->convertToUniformArea(value);
+					area->convertToUniformArea(areaPools, value);
 					//						std::cout << "Consolidated area: "<<area->getBox()<<"\n";
 				}
 			} // else area->isUniform()
 		}
 	}
-
-public:
-	VoxelStorage(VoxelStorage && other) : nullVoxel(other.nullVoxel), root(std::move(other.root)) {
-	}
-	explicit VoxelStorage(const Voxel_t & _nullVoxel) : nullVoxel(_nullVoxel) {
-	}
-
-	//! Set the value @p voxel at the given @p position without consolidating (combining uniform subtrees)
-	void _set(const Vec3_t & pos, const Voxel_t & voxel) {
-		findOrCreateBlock(pos)[posToBlockIdx(pos)] = voxel;
-	}
-
-	//! Set the value @p voxel at the given @p position.
-	void set(const Vec3_t & pos, const Voxel_t & voxel) {
-		auto & block = findOrCreateBlock(pos);
-		block[posToBlockIdx(pos)] = voxel;
-
-		for (uint32_t i = 0; i < blockSize; ++i) { // check if block became uniform
-			if (block[i] != voxel)
-				return;
-		}
-		consolidate(root.get());
-	}
-	//! Return the value at the given @p position. If the value has not been set, nullVoxel is returned.
-	const Voxel_t & get(const Vec3_t & pos) const {
-		if (!root || !root->contains(pos))
-			return nullVoxel;
-
-		const Area * currentArea = root.get();
-		while (true) {
-			const block_t * block = currentArea->getBlock();
-			if (block)
-				return (*block)[posToBlockIdx(pos)];
-			const Area * child = currentArea->getChild(currentArea->getChildIndex(pos));
-			if (!child || !child->contains(pos))
-				return currentArea->uniformValue;
-			currentArea = child;
-		}
-	}
-	//! Fill the given @p area with the given value @p voxel.
-	void fill(const Box_t & fillArea, const Voxel_t & voxel) {
-		//			std::cout << "fill:"<<fillArea<<" "<<std::endl;
-
-		// assure properly sized root node.
-		if (!root || !root->getBox().contains(fillArea)) {
-			findOrCreateBlock(fillArea.getMin());
-			findOrCreateBlock(fillArea.getMax());
-		}
-
+	/*! Fill the intersection of @p area's subtree and @p fillArea with @p voxel.
+		If @p spawnedTasks is given, child areas with a side length larger than @p sequentialCutoff are not processed,
+		but appended to @p spawnedTasks.
+	*/
+	void fillSubtree(Area * area, const Box_t & fillArea, const Voxel_t & voxel, Pools & areaPools,
+					 std::vector<Area *> * spawnedTasks, uinteger_t sequentialCutoff) {
 		//			std::cout << "start filling "<<std::endl;
 
 		std::stack<Area *> todo;
-		todo.push(root.get());
+		todo.push(area);
+		auto schedule = [&](Area * child) {
+			if (spawnedTasks && child->sideLength > sequentialCutoff)
+				spawnedTasks->push_back(child);
+			else
+				todo.push(child);
+		};
 		while (!todo.empty()) {
 			Area * currentArea = todo.top();
 			todo.pop();
@@ -365,7 +468,7 @@ public:
 
 			const Box_t areaBox(currentArea->getBox());
 			if (fillArea.contains(areaBox)) {
-				currentArea->convertToUniformArea(voxel);
+				currentArea->convertToUniformArea(areaPools, voxel);
 				//					std::cout << " >F "<< currentArea->origin<<" : "<<currentArea->sideLength
 				//<<std::endl;
 				//					std::cout << " >F "<< currentArea->sideLength;
@@ -373,7 +476,7 @@ public:
 				currentArea->markedForConsolidation = true;
 				if (currentArea->isBlock() || currentArea->sideLength == blockSideLength) {
 					const Box_t intersection = Intersection::getBoxBoxIntersection(areaBox, fillArea);
-					block_t & block = currentArea->assureBlock();
+					block_t & block = currentArea->assureBlock(areaPools);
 					for (integer_t x = intersection.getMinX(); x <= intersection.getMaxX(); ++x) {
 						for (integer_t y = intersection.getMinY(); y <= intersection.getMaxY(); ++y) {
 							for (integer_t z = intersection.getMinZ(); z <= intersection.getMaxZ(); ++z) {
@@ -384,7 +487,7 @@ public:
 					//						std::cout << " >B "<< currentArea->origin<<" : "<<currentArea->sideLength
 					//<<std::endl;
 				} else { // uniform value or container
-					currentArea->assureContainer();
+					currentArea->assureContainer(areaPools);
 					for (uint8_t i = 0; i < 8; ++i) {
 						const Box_t octantIntersection =
 								Intersection::getBoxBoxIntersection(currentArea->getOctant(i), fillArea);
@@ -392,7 +495,7 @@ public:
 							continue;
 						Area * child = currentArea->getChild(i);
 						if (child && child->getBox().contains(octantIntersection)) { // fill inside existing child...
-							todo.push(child);
+							schedule(child);
 						} else if (!child) { // create new child covering the filling
 							const auto enclosingBox = getEnclosingAreaBox(octantIntersection);
 							//								std::cout << " >>a:              \t"<< currentArea->getOrigin()
@@ -403,7 +506,8 @@ public:
 							//<<std::endl;
 							//								std::cout << " >>enclosingBox:\t"<< enclosingBox.first<<" :
 							//"<<enclosingBox.second <<std::endl;
-							todo.push(currentArea->insertIntermediateChild(enclosingBox.first, enclosingBox.second));
+							schedule(currentArea->insertIntermediateChild(areaPools, enclosingBox.first,
+																		  enclosingBox.second));
 						} else { // create an intermediate child covering the filled area and the old child
 							//								std::cout << " B ";
 							//								std::cout << "\n >>
@@ -415,20 +519,486 @@ public:
 							//								std::cout << "\n >> combined:\t"<<b;
 							//								std::cout << "\n >> area:\t"<<enclosingBox.first<<" :
 							//"<<enclosingBox.second<<"\n";
-							todo.push(currentArea->insertIntermediateChild(enclosingBox.first, enclosingBox.second));
+							schedule(currentArea->insertIntermediateChild(areaPools, enclosingBox.first,
+																		  enclosingBox.second));
 						}
 					}
 				}
 				continue;
 			} // else not intersecting -> skip
 		}
-		consolidate(root.get());
+	}
+	//! Return the box covered by a serialized uniform area; like Area::getBox(), the maximum is inclusive.
+	static Box_t getUniformAreaBox(const std::tuple<Vec3_t, uinteger_t, Voxel_t> & uniformArea) {
+		const integer_t maxOffset = static_cast<integer_t>(std::get<1>(uniformArea)) - 1;
+		return Box_t(std::get<0>(uniformArea), std::get<0>(uniformArea) + Vec3_t(maxOffset, maxOffset, maxOffset));
+	}
+	//! Collect the marked areas with a side length of at most @p sequentialCutoff whose parents are larger.
+	void collectConsolidationTasks(Area * area, uinteger_t sequentialCutoff, std::vector<Area *> & tasks) {
+		if (!area || !area->markedForConsolidation)
+			return;
+		if (area->sideLength <= sequentialCutoff) {
+			tasks.push_back(area);
+		} else if (area->isContainer()) {
+			for (uint8_t i = 0; i < 8; ++i)
+				collectConsolidationTasks(area->getChild(i), sequentialCutoff, tasks);
+		}
+	}
+	/*! Process the disjoint subtrees in @p tasks by a pool of @p numThreads threads.
+		@p process(area, pools, spawnedTasks) may append further disjoint subtrees to spawnedTasks. Every thread
+		allocates from its own pools, which are merged into the storage's pools when the thread is done.
+		If a task throws, the remaining tasks are dropped and the first exception is rethrown after all threads have
+		been joined. The areas processed so far keep their changes.
+	*/
+	template <typename Process_t>
+	void processInParallel(std::vector<Area *> tasks, unsigned int numThreads, Process_t process) {
+		std::size_t pendingTasks = tasks.size();
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::exception_ptr error; // first exception thrown by a task
+		bool stopped = false;
+
+		auto worker = [&]() {
+			Pools threadPools;
+			std::vector<Area *> spawnedTasks;
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				condition.wait(lock, [&]() { return stopped || !tasks.empty() || pendingTasks == 0; });
+				if (stopped || tasks.empty())
+					break;
+				Area * area = tasks.back();
+				tasks.pop_back();
+				lock.unlock();
+
+				try {
+					process(area, threadPools, spawnedTasks);
+					lock.lock();
+					tasks.insert(tasks.end(), spawnedTasks.begin(), spawnedTasks.end());
+				} catch (...) {
+					if (!lock.owns_lock())
+						lock.lock();
+					if (!error)
+						error = std::current_exception();
+					stopped = true;
+					condition.notify_all();
+					break;
+				}
+				pendingTasks += spawnedTasks.size();
+				spawnedTasks.clear();
+				--pendingTasks;
+				condition.notify_all();
+			}
+			// the areas allocated by this thread are part of the tree, also if a task failed
+			pools.merge(std::move(threadPools));
+		};
+
+		//! Stops and joins the threads when leaving the scope, also if starting a thread fails.
+		struct ThreadGuard {
+			std::vector<std::thread> threads;
+			std::mutex & mutex;
+			std::condition_variable & condition;
+			bool & stopped;
+
+			~ThreadGuard() {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stopped = true;
+				}
+				condition.notify_all();
+				for (auto & thread : threads)
+					thread.join();
+			}
+		};
+
+		if (numThreads == 0)
+			numThreads = std::max(1u, std::thread::hardware_concurrency());
+		{
+			ThreadGuard guard{{}, mutex, condition, stopped};
+			for (unsigned int i = 1; i < numThreads; ++i)
+				guard.threads.emplace_back(worker);
+			worker();
+		}
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	/*! Front-to-back traversal of the areas hit by a ray or segment, used by findFirstVoxelAlongRay().
+		A voxel at position p covers the cube [p, p+1). Uniform areas and the parts of a container that are not covered
+		by a child are tested as a whole; only inside blocks, the voxels are visited one by one (Amanatides-Woo DDA).
+	*/
+	template <typename Line_t, typename Predicate_t>
+	class RayTraversal {
+		typedef decltype(std::declval<const Line_t &>().getMaxParam()) value_t;
+		typedef _Vec3<value_t> vec_t;
+
+		const VoxelStorage & storage;
+		const vec_t origin;
+		const vec_t direction;
+		vec_t inverseDirection;
+		Predicate_t & predicate;
+
+	public:
+		Vec3_t hitPosition;
+		value_t hitParam;
+		const Voxel_t * hitVoxel;
+
+		RayTraversal(const VoxelStorage & _storage, const Line_t & line, Predicate_t & _predicate)
+				: storage(_storage),
+				  origin(line.getOrigin()),
+				  direction(line.getDirection()),
+				  predicate(_predicate),
+				  hitParam(0),
+				  hitVoxel(nullptr) {
+			for (uint8_t a = 0; a < 3; ++a)
+				inverseDirection[a] = direction[a] != 0 ? 1 / direction[a] : 0;
+		}
+
+		//! Restrict [t0, t1] to the part of the ray inside the cube at @p min; return false if nothing remains.
+		bool clip(const Vec3_t & min, uinteger_t sideLength, value_t & t0, value_t & t1) const {
+			for (uint8_t a = 0; a < 3; ++a) {
+				const value_t low = static_cast<value_t>(min[a]);
+				const value_t high = low + static_cast<value_t>(sideLength);
+				if (direction[a] == 0) {
+					if (origin[a] < low || origin[a] >= high)
+						return false;
+				} else {
+					value_t tLow = (low - origin[a]) * inverseDirection[a];
+					value_t tHigh = (high - origin[a]) * inverseDirection[a];
+					if (tLow > tHigh)
+						std::swap(tLow, tHigh);
+					t0 = std::max(t0, tLow);
+					t1 = std::min(t1, tHigh);
+				}
+			}
+			return t0 < t1;
+		}
+		//! Return the voxel the ray enters at parameter @p t.
+		Vec3_t getEnteredVoxel(value_t t) const {
+			Vec3_t pos;
+			for (uint8_t a = 0; a < 3; ++a) {
+				const value_t coordinate = origin[a] + direction[a] * t;
+				pos[a] = static_cast<integer_t>(direction[a] < 0 ? std::ceil(coordinate) - 1 : std::floor(coordinate));
+			}
+			return pos;
+		}
+		//! Like getEnteredVoxel(), but the result is clamped into the cube at @p min to compensate rounding errors.
+		Vec3_t getEnteredVoxel(value_t t, const Vec3_t & min, uinteger_t sideLength) const {
+			Vec3_t pos = getEnteredVoxel(t);
+			for (uint8_t a = 0; a < 3; ++a)
+				pos[a] = std::max(min[a], std::min(pos[a], static_cast<integer_t>(min[a] + sideLength - 1)));
+			return pos;
+		}
+		bool setHit(const Voxel_t & voxel, value_t t, const Vec3_t & pos) {
+			hitVoxel = &voxel;
+			hitParam = t;
+			hitPosition = pos;
+			return true;
+		}
+
+		/*! Traverse the interval [t0, t1] of a region having the value @p gapValue except for the part covered by
+			@p child. The region is the cube at @p min; if @p min is nullptr, the region is unbounded.
+		*/
+		bool traverseRegion(const Voxel_t & gapValue, const Area * child, value_t t0, value_t t1, const Vec3_t * min,
+							uinteger_t sideLength) {
+			const bool gapMatches = predicate(gapValue);
+			value_t c0 = t0;
+			value_t c1 = t1;
+			const bool childHit = child && clip(child->origin, child->sideLength, c0, c1);
+			if (gapMatches && (!childHit || c0 > t0))
+				return setHit(gapValue, t0, min ? getEnteredVoxel(t0, *min, sideLength) : getEnteredVoxel(t0));
+			if (childHit && traverseArea(child, c0, c1))
+				return true;
+			if (gapMatches && childHit && c1 < t1)
+				return setHit(gapValue, c1, min ? getEnteredVoxel(c1, *min, sideLength) : getEnteredVoxel(c1));
+			return false;
+		}
+		//! Traverse the interval [t0, t1] of the ray, which lies inside @p area.
+		bool traverseArea(const Area * area, value_t t0, value_t t1) {
+			if (area->isBlock()) {
+				return traverseBlock(area, t0, t1);
+			} else if (area->isUniform()) {
+				return predicate(area->uniformValue)
+							   && setHit(area->uniformValue, t0, getEnteredVoxel(t0, area->origin, area->sideLength));
+			}
+			// container: visit the octants ordered by their entry parameter
+			struct Octant {
+				value_t t0, t1;
+				uint8_t index;
+			};
+			std::array<Octant, 8> octants;
+			uint8_t numOctants = 0;
+			const uinteger_t octantSideLength = area->sideLength / 2;
+			for (uint8_t i = 0; i < 8; ++i) {
+				Octant octant{t0, t1, i};
+				if (!clip(area->getOctantOrigin(i), octantSideLength, octant.t0, octant.t1))
+					continue;
+				uint8_t j = numOctants++; // insertion sort; at most four octants are hit
+				for (; j > 0 && octants[j - 1].t0 > octant.t0; --j)
+					octants[j] = octants[j - 1];
+				octants[j] = octant;
+			}
+			for (uint8_t i = 0; i < numOctants; ++i) {
+				const Octant & octant = octants[i];
+				const Vec3_t octantOrigin = area->getOctantOrigin(octant.index);
+				if (traverseRegion(area->uniformValue, area->getChild(octant.index), octant.t0, octant.t1,
+								   &octantOrigin, octantSideLength))
+					return true;
+			}
+			return false;
+		}
+		//! Visit the voxels of the block of @p area along the interval [t0, t1] of the ray.
+		bool traverseBlock(const Area * area, value_t t0, value_t t1) {
+			const block_t & block = *area->getBlock();
+			Vec3_t pos = getEnteredVoxel(t0, area->origin, area->sideLength);
+			std::array<integer_t, 3> step;
+			std::array<value_t, 3> tNext;
+			std::array<value_t, 3> tDelta;
+			for (uint8_t a = 0; a < 3; ++a) {
+				if (direction[a] > 0) {
+					step[a] = 1;
+					tNext[a] = (static_cast<value_t>(pos[a] + 1) - origin[a]) * inverseDirection[a];
+					tDelta[a] = inverseDirection[a];
+				} else if (direction[a] < 0) {
+					step[a] = -1;
+					tNext[a] = (static_cast<value_t>(pos[a]) - origin[a]) * inverseDirection[a];
+					tDelta[a] = -inverseDirection[a];
+				} else {
+					step[a] = 0;
+					tNext[a] = std::numeric_limits<value_t>::infinity();
+					tDelta[a] = 0;
+				}
+			}
+			const Vec3_t & min = area->origin;
+			const Vec3_t max = area->getMaxPosition();
+			value_t t = t0;
+			while (true) {
+				const Voxel_t & voxel = block[storage.posToBlockIdx(pos)];
+				if (predicate(voxel))
+					return setHit(voxel, t, pos);
+				const uint8_t a = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+				t = tNext[a];
+				pos[a] += step[a];
+				if (t >= t1 || pos[a] < min[a] || pos[a] > max[a])
+					return false;
+				tNext[a] += tDelta[a];
+			}
+		}
+		//! Traverse the whole line; outside of the root, the value is nullVoxel.
+		bool traverse(value_t t0, value_t t1) {
+			if (!(t0 < t1))
+				return predicate(storage.nullVoxel) && setHit(storage.nullVoxel, t0, getEnteredVoxel(t0));
+			return traverseRegion(storage.nullVoxel, storage.root, t0, t1, nullptr, 0);
+		}
+	};
+	//! Shared implementation of the ray and segment queries.
+	template <typename Line_t, typename Predicate_t>
+	const Voxel_t * findFirstVoxelAlongLine(const Line_t & line, Predicate_t & predicate, Vec3_t * hitPosition,
+											decltype(line.getMaxParam()) * hitParam) const {
+		RayTraversal<Line_t, Predicate_t> traversal(*this, line, predicate);
+		if (!traversal.traverse(line.getMinParam(), line.getMaxParam()))
+			return nullptr;
+		if (hitPosition)
+			*hitPosition = traversal.hitPosition;
+		if (hitParam)
+			*hitParam = traversal.hitParam;
+		return traversal.hitVoxel;
+	}
+
+public:
+	VoxelStorage(VoxelStorage && other)
+			: nullVoxel(other.nullVoxel), pools(std::move(other.pools)), root(other.root), revision(0) {
+		other.root = nullptr;
+		++other.revision;
+	}
+	explicit VoxelStorage(const Voxel_t & _nullVoxel) : nullVoxel(_nullVoxel), root(nullptr), revision(0) {
+	}
+	~VoxelStorage() {
+		clear();
+	}
+
+	//! Set the value @p voxel at the given @p position without consolidating (combining uniform subtrees)
+	void _set(const Vec3_t & pos, const Voxel_t & voxel) {
+		findOrCreateBlock(pos)[posToBlockIdx(pos)] = voxel;
+	}
+
+	//! Combine uniform subtrees that have been changed by _set() or an Accessor.
+	void consolidate() {
+		consolidateFrom(root);
+	}
+	/*! Like consolidate(), but changed subtrees with a side length of at most @p sequentialCutoff are consolidated
+		by a pool of threads. The result is identical to the one of consolidate().
+		@param numThreads Number of threads including the calling thread. Zero uses the number of hardware threads.
+	*/
+	void consolidate(unsigned int numThreads, uinteger_t sequentialCutoff = 64) {
+		++revision;
+		std::vector<Area *> tasks;
+		collectConsolidationTasks(root, sequentialCutoff, tasks);
+		processInParallel(std::move(tasks), numThreads, [this](Area * area, Pools & areaPools, std::vector<Area *> &) {
+			consolidateSubtree(area, areaPools);
+		});
+		consolidateSubtree(root, pools);
+	}
+
+	//! Set the value @p voxel at the given @p position.
+	void set(const Vec3_t & pos, const Voxel_t & voxel) {
+		auto & block = findOrCreateBlock(pos);
+		block[posToBlockIdx(pos)] = voxel;
+
+		for (uint32_t i = 0; i < blockSize; ++i) { // check if block became uniform
+			if (block[i] != voxel)
+				return;
+		}
+		consolidateFrom(root);
+	}
+	/*! Set the values of multiple voxels given as (position, value) pairs.
+		The writes are grouped by block, so that every affected block is looked up only once; the changed subtrees are
+		consolidated once after all values have been written. If a position occurs more than once, the last value wins.
+	*/
+	void set(const std::vector<std::pair<Vec3_t, Voxel_t>> & voxels) {
+		if (voxels.empty())
+			return;
+
+		std::vector<std::pair<Vec3_t, uint32_t>> blockOrder; // (block origin, index into voxels)
+		blockOrder.reserve(voxels.size());
+		Box_t bounds;
+		bounds.invalidate();
+		for (uint32_t i = 0; i < voxels.size(); ++i) {
+			blockOrder.emplace_back(calcOrigin(voxels[i].first, blockSideLength), i);
+			bounds.include(voxels[i].first);
+		}
+		std::stable_sort(blockOrder.begin(), blockOrder.end(),
+						 [](const std::pair<Vec3_t, uint32_t> & a, const std::pair<Vec3_t, uint32_t> & b) {
+							 return std::make_tuple(a.first.z(), a.first.y(), a.first.x())
+									< std::make_tuple(b.first.z(), b.first.y(), b.first.x());
+						 });
+
+		// assure properly sized root node.
+		if (!root || !root->getBox().contains(bounds)) {
+			findOrCreateBlock(bounds.getMin());
+			findOrCreateBlock(bounds.getMax());
+		}
+
+		block_t * block = nullptr;
+		Vec3_t blockOrigin;
+		for (const auto & entry : blockOrder) {
+			if (!block || entry.first != blockOrigin) {
+				block = &findOrCreateBlock(entry.first);
+				blockOrigin = entry.first;
+			}
+			const auto & voxel = voxels[entry.second];
+			(*block)[posToBlockIdx(voxel.first)] = voxel.second;
+		}
+		consolidateFrom(root);
+	}
+	/*! Set the values of the dense sub-volume @p area.
+		@p values contains one value per voxel of @p area (bounds inclusive); x varies fastest, then y, then z.
+		Every affected block is looked up only once and the changed subtrees are consolidated at the end.
+	*/
+	void set(const Box_t & area, const std::vector<Voxel_t> & values) {
+		if (area.isInvalid())
+			throw std::invalid_argument("VoxelStorage::set: Invalid area.");
+		const integer_t sizeX = area.getMaxX() - area.getMinX() + 1;
+		const integer_t sizeY = area.getMaxY() - area.getMinY() + 1;
+		const integer_t sizeZ = area.getMaxZ() - area.getMinZ() + 1;
+		if (values.size() != static_cast<size_t>(sizeX) * static_cast<size_t>(sizeY) * static_cast<size_t>(sizeZ))
+			throw std::invalid_argument("VoxelStorage::set: Number of values does not match the size of the area.");
+
+		// assure properly sized root node.
+		if (!root || !root->getBox().contains(area)) {
+			findOrCreateBlock(area.getMin());
+			findOrCreateBlock(area.getMax());
+		}
+
+		const integer_t side = static_cast<integer_t>(blockSideLength);
+		const Vec3_t firstBlock = calcOrigin(area.getMin(), blockSideLength);
+		for (integer_t bz = firstBlock.z(); bz <= area.getMaxZ(); bz += side) {
+			const integer_t minZ = std::max(bz, area.getMinZ());
+			const integer_t maxZ = std::min(bz + side - 1, area.getMaxZ());
+			for (integer_t by = firstBlock.y(); by <= area.getMaxY(); by += side) {
+				const integer_t minY = std::max(by, area.getMinY());
+				const integer_t maxY = std::min(by + side - 1, area.getMaxY());
+				for (integer_t bx = firstBlock.x(); bx <= area.getMaxX(); bx += side) {
+					const integer_t minX = std::max(bx, area.getMinX());
+					const integer_t maxX = std::min(bx + side - 1, area.getMaxX());
+					block_t & block = findOrCreateBlock(Vec3_t(bx, by, bz));
+					for (integer_t z = minZ; z <= maxZ; ++z) {
+						for (integer_t y = minY; y <= maxY; ++y) {
+							size_t valueIndex = (static_cast<size_t>(z - area.getMinZ()) * sizeY
+												 + static_cast<size_t>(y - area.getMinY())) * sizeX
+												+ static_cast<size_t>(minX - area.getMinX());
+							for (integer_t x = minX; x <= maxX; ++x)
+								block[posToBlockIdx(Vec3_t(x, y, z))] = values[valueIndex++];
+						}
+					}
+				}
+			}
+		}
+		consolidateFrom(root);
+	}
+	//! Return the value at the given @p position. If the value has not been set, nullVoxel is returned.
+	const Voxel_t & get(const Vec3_t & pos) const {
+		if (!root || !root->contains(pos))
+			return nullVoxel;
+
+		const Area * currentArea = root;
+		while (true) {
+			const block_t * block = currentArea->getBlock();
+			if (block)
+				return (*block)[posToBlockIdx(pos)];
+			const Area * child = currentArea->getChild(currentArea->getChildIndex(pos));
+			if (!child || !child->contains(pos))
+				return currentArea->uniformValue;
+			currentArea = child;
+		}
+	}
+	//! Fill the given @p area with the given value @p voxel.
+	void fill(const Box_t & fillArea, const Voxel_t & voxel) {
+		//			std::cout << "fill:"<<fillArea<<" "<<std::endl;
+		++revision;
+
+		// assure properly sized root node.
+		if (!root || !root->getBox().contains(fillArea)) {
+			findOrCreateBlock(fillArea.getMin());
+			findOrCreateBlock(fillArea.getMax());
+		}
+
+		fillSubtree(root, fillArea, voxel, pools, nullptr, 0);
+		consolidateFrom(root);
+	}
+	/*! Like fill(const Box_t &, const Voxel_t &), but using multiple threads.
+		The root is adjusted by the calling thread; afterwards, disjoint subtrees are filled and consolidated by a pool
+		of threads. Areas with a side length of at most @p sequentialCutoff are processed by a single thread. The
+		result is identical to the one of the sequential fill.
+		@param numThreads Number of threads including the calling thread. Zero uses the number of hardware threads.
+	*/
+	void fill(const Box_t & fillArea, const Voxel_t & voxel, unsigned int numThreads,
+			  uinteger_t sequentialCutoff = 64) {
+		++revision;
+
+		// assure properly sized root node.
+		if (!root || !root->getBox().contains(fillArea)) {
+			findOrCreateBlock(fillArea.getMin());
+			findOrCreateBlock(fillArea.getMax());
+		}
+		processInParallel(std::vector<Area *>(1, root), numThreads,
+						  [&](Area * area, Pools & areaPools, std::vector<Area *> & spawnedTasks) {
+							  fillSubtree(area, fillArea, voxel, areaPools, &spawnedTasks, sequentialCutoff);
+						  });
+		consolidate(numThreads, sequentialCutoff);
 	}
 	//		std::pair<bool,Voxel_t> isUniform(const Box_t& area)bool;
 	//		bool isUniform(const Box_t& area,const Voxel_t& voxel)bool;
 	//! Remove all values.
 	void clear() {
-		root.reset();
+		++revision;
+		if (root && !std::is_trivially_destructible<Voxel_t>::value)
+			pools.destroyArea(root);
+		root = nullptr;
+		pools.release();
+	}
+	//! Return the number of bytes allocated for areas, children arrays and blocks.
+	size_t getMemoryUsage() const {
+		return pools.areas.getMemoryUsage() + pools.children.getMemoryUsage() + pools.blocks.getMemoryUsage();
 	}
 	/*! experimental!
 		\note queryBox must be block-aligned
@@ -441,10 +1011,10 @@ public:
 		std::vector<std::tuple<Vec3_t, uinteger_t, Voxel_t>> uniformAreas;
 		std::vector<std::tuple<Vec3_t, block_t>> singleValues;
 
-		consolidate(root.get());
+		consolidateFrom(root);
 		std::stack<Area *> todo;
 		if (root)
-			todo.push(root.get());
+			todo.push(root);
 		while (!todo.empty()) {
 			Area * currentArea = todo.top();
 			todo.pop();
@@ -452,7 +1022,7 @@ public:
 			if (!Intersection::isBoxIntersectingBox(queryBox, currentArea->getBox()))
 				continue;
 			if (currentArea->isBlock()) {
-				singleValues.emplace_back(currentArea->getOrigin(), currentArea->assureBlock());
+				singleValues.emplace_back(currentArea->getOrigin(), *currentArea->getBlock());
 			} else if (currentArea->isContainer()) {
 				for (uint8_t i = 0; i < 8; ++i) {
 					Area * child = currentArea->getChild(i);
@@ -469,15 +1039,55 @@ public:
 	}
 
 	void deserialize(const serializationData_t & data) {
+		for (const auto & uniformArea : data.first)
+			fill(getUniformAreaBox(uniformArea), std::get<2>(uniformArea));
+		for (const auto & blockData : data.second)
+			findOrCreateBlock(std::get<0>(blockData)) = std::get<1>(blockData);
+		consolidateFrom(root);
+	}
+	/*! Like deserialize(const serializationData_t &), but uniform areas larger than @p sequentialCutoff are filled
+		and the result is consolidated using multiple threads. The result is identical to the sequential one.
+		@param numThreads Number of threads including the calling thread. Zero uses the number of hardware threads.
+	*/
+	void deserialize(const serializationData_t & data, unsigned int numThreads, uinteger_t sequentialCutoff = 64) {
 		for (const auto & uniformArea : data.first) {
-			const Box_t b(std::get<0>(uniformArea),
-						  std::get<0>(uniformArea) + Vec3_t(std::get<1>(uniformArea), std::get<1>(uniformArea),
-															std::get<1>(uniformArea)));
-			fill(b, std::get<2>(uniformArea));
+			if (std::get<1>(uniformArea) > sequentialCutoff)
+				fill(getUniformAreaBox(uniformArea), std::get<2>(uniformArea), numThreads, sequentialCutoff);
+			else
+				fill(getUniformAreaBox(uniformArea), std::get<2>(uniformArea));
 		}
 		for (const auto & blockData : data.second)
 			findOrCreateBlock(std::get<0>(blockData)) = std::get<1>(blockData);
-		consolidate(root.get());
+		consolidate(numThreads, sequentialCutoff);
+	}
+	/*! Return the first voxel along the ray whose value is not nullVoxel.
+		Uniform areas and empty regions are skipped as a whole, so long rays through sparse volumes are cheap.
+		@param hitPosition If given, the position of the hit voxel is stored here.
+		@param hitParam If given, the ray parameter at which the hit voxel is entered is stored here.
+		@return Pointer to the value inside the storage, or nullptr if no voxel is hit.
+	*/
+	const Voxel_t * findFirstVoxelAlongRay(const Ray3f & ray, Vec3_t * hitPosition = nullptr,
+										   float * hitParam = nullptr) const {
+		auto isSet = [this](const Voxel_t & voxel) { return voxel != nullVoxel; };
+		return findFirstVoxelAlongLine(ray, isSet, hitPosition, hitParam);
+	}
+	//! Return the first voxel along the ray for which @p predicate(const Voxel_t &) returns @c true.
+	template <typename Predicate_t>
+	const Voxel_t * findFirstVoxelAlongRay(const Ray3f & ray, Predicate_t predicate, Vec3_t * hitPosition = nullptr,
+										   float * hitParam = nullptr) const {
+		return findFirstVoxelAlongLine(ray, predicate, hitPosition, hitParam);
+	}
+	//! Return the first voxel along the segment whose value is not nullVoxel. @see findFirstVoxelAlongRay
+	const Voxel_t * findFirstVoxelAlongSegment(const Segment3f & segment, Vec3_t * hitPosition = nullptr,
+											   float * hitParam = nullptr) const {
+		auto isSet = [this](const Voxel_t & voxel) { return voxel != nullVoxel; };
+		return findFirstVoxelAlongLine(segment, isSet, hitPosition, hitParam);
+	}
+	//! Return the first voxel along the segment for which @p predicate(const Voxel_t &) returns @c true.
+	template <typename Predicate_t>
+	const Voxel_t * findFirstVoxelAlongSegment(const Segment3f & segment, Predicate_t predicate,
+											   Vec3_t * hitPosition = nullptr, float * hitParam = nullptr) const {
+		return findFirstVoxelAlongLine(segment, predicate, hitPosition, hitParam);
 	}
 	//! Get the (block aligned) bounding box around the set voxels.
 	Box_t getBlockBounds() const {
@@ -485,7 +1095,7 @@ public:
 		b.invalidate();
 		std::stack<const Area *> todo;
 		if (root)
-			todo.push(root.get());
+			todo.push(root);
 		while (!todo.empty()) {
 			const Area * currentArea = todo.top();
 			todo.pop();
@@ -501,7 +1111,127 @@ public:
 		}
 		return b;
 	}
+
+	/*! Cursor for spatially coherent reads and writes, e.g. in stencil loops or flood fills.
+		The accessor remembers the leaves (blocks or uniform areas) of the last visited blocks in a small cache that is
+		indexed by the lowest bit of the block coordinates, so that all blocks of a 2x2x2 neighborhood can be cached at
+		the same time. Accesses to cached blocks take constant time. Otherwise, the path from the root to the last
+		visited leaf is only walked up until it contains the position, which is short for neighboring blocks.
+		Writes are not consolidated; call VoxelStorage::consolidate() afterwards. The storage may be modified between
+		two accesses; the accessor detects this and restarts at the root.
+	*/
+	class Accessor {
+		struct CacheEntry {
+			Vec3_t blockOrigin;
+			Area * leaf;
+			block_t * block; //!< leaf's block; stays valid until the storage's revision changes
+			bool marked; //!< true iff leaf and all its ancestors are marked for consolidation
+		};
+		VoxelStorage & storage;
+		std::array<CacheEntry, 8> cache;
+		std::vector<Area *> path;
+		uint32_t revision;
+		bool pathMarked; //!< true iff all areas in path are marked for consolidation
+
+		//! Drop all cached areas as they may have been removed from the storage.
+		void reset() {
+			for (auto & entry : cache)
+				entry.leaf = nullptr;
+			path.clear();
+			revision = storage.revision;
+		}
+		static CacheEntry & getCacheEntry(std::array<CacheEntry, 8> & cache, const Vec3_t & blockOrigin) {
+			return cache[((blockOrigin.x() >> blockSizePow) & 1) | (((blockOrigin.y() >> blockSizePow) & 1) << 1)
+						 | (((blockOrigin.z() >> blockSizePow) & 1) << 2)];
+		}
+		//! Remove the areas not containing @p pos from the end of the path.
+		void ascendTo(const Vec3_t & pos) {
+			while (!path.empty() && !path.back()->contains(pos))
+				path.pop_back();
+		}
+		//! Slow path of get(): walk the tree starting at the last visited area and update the cache @p entry.
+		const Voxel_t & lookup(const Vec3_t & pos, const Vec3_t & blockOrigin, CacheEntry & entry) {
+			ascendTo(pos);
+			if (path.empty()) {
+				if (!storage.root || !storage.root->contains(pos))
+					return storage.nullVoxel;
+				path.push_back(storage.root);
+				pathMarked = storage.root->markedForConsolidation;
+			}
+			while (true) {
+				Area * currentArea = path.back();
+				if (!currentArea->isContainer()) {
+					entry.blockOrigin = blockOrigin;
+					entry.leaf = currentArea;
+					entry.block = currentArea->getBlock();
+					entry.marked = pathMarked;
+					return entry.block ? (*entry.block)[storage.posToBlockIdx(pos)] : currentArea->uniformValue;
+				}
+				Area * child = currentArea->getChild(currentArea->getChildIndex(pos));
+				if (!child || !child->contains(pos))
+					return currentArea->uniformValue;
+				path.push_back(child);
+				pathMarked = pathMarked && child->markedForConsolidation;
+			}
+		}
+		//! Slow path of set(): find or create the block starting at the last visited area; update the cache @p entry.
+		block_t & lookupBlock(const Vec3_t & pos, const Vec3_t & blockOrigin, CacheEntry & entry) {
+			ascendTo(pos);
+			if (path.empty()) {
+				path.push_back(storage.assureRoot(pos));
+			} else if (!pathMarked) {
+				for (auto area : path)
+					area->markedForConsolidation = true;
+			}
+			block_t & block = storage.findOrCreateBlock(path.back(), pos, &path);
+			pathMarked = true;
+			entry.blockOrigin = blockOrigin;
+			entry.leaf = path.back();
+			entry.block = &block;
+			entry.marked = true;
+			return block;
+		}
+
+	public:
+		explicit Accessor(VoxelStorage & _storage) : storage(_storage), pathMarked(false) {
+			reset();
+		}
+
+		//! Return the value at the given @p position. If the value has not been set, nullVoxel is returned.
+		const Voxel_t & get(const Vec3_t & pos) {
+			if (revision != storage.revision)
+				reset();
+			const Vec3_t blockOrigin = storage.calcOrigin(pos, blockSideLength);
+			CacheEntry & entry = getCacheEntry(cache, blockOrigin);
+			if (entry.leaf && entry.blockOrigin == blockOrigin) {
+				if (entry.block)
+					return (*entry.block)[storage.posToBlockIdx(pos)];
+				else if (entry.leaf->isUniform())
+					return entry.leaf->uniformValue;
+			}
+			return lookup(pos, blockOrigin, entry);
+		}
+
+		//! Set the value @p voxel at the given @p position without consolidating.
+		void set(const Vec3_t & pos, const Voxel_t & voxel) {
+			if (revision != storage.revision)
+				reset();
+			const Vec3_t blockOrigin = storage.calcOrigin(pos, blockSideLength);
+			CacheEntry & entry = getCacheEntry(cache, blockOrigin);
+			if (entry.leaf && entry.block && entry.marked && entry.blockOrigin == blockOrigin)
+				(*entry.block)[storage.posToBlockIdx(pos)] = voxel;
+			else
+				lookupBlock(pos, blockOrigin, entry)[storage.posToBlockIdx(pos)] = voxel;
+		}
+	};
 };
+
+template <typename Voxel_t, unsigned int blockSizePow, typename integer_t, typename uinteger_t>
+const uinteger_t VoxelStorage<Voxel_t, blockSizePow, integer_t, uinteger_t>::blockSideLength;
+template <typename Voxel_t, unsigned int blockSizePow, typename integer_t, typename uinteger_t>
+const uinteger_t VoxelStorage<Voxel_t, blockSizePow, integer_t, uinteger_t>::blockMask;
+template <typename Voxel_t, unsigned int blockSizePow, typename integer_t, typename uinteger_t>
+const uint32_t VoxelStorage<Voxel_t, blockSizePow, integer_t, uinteger_t>::blockSize;
 }
 
 #endif /* VOXEL_STORAGE_H */
@@ -0,0 +1,378 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include "CompactPointOctree.h"
+#include "PointOctree.h"
+#include "PointTestHelper.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+#define REQUIRE_EQUAL(a,b) REQUIRE((a) == (b))
+
+using namespace PointTestHelper;
+
+namespace {
+std::size_t countNodes(const Geometry::PointOctree<IdPoint> & cell) {
+	std::size_t count = 1;
+	for (const auto & child : cell.getChildren()) {
+		count += countNodes(child);
+	}
+	return count;
+}
+}
+
+TEST_CASE("CompactPointOctreeTest_queries", "[CompactPointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 20000, -1.0f, 1.0f);
+	PointOctree<IdPoint> octree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8);
+	for (const auto & point : input) {
+		REQUIRE(octree.insert(point));
+	}
+
+	const CompactPointOctree<IdPoint> compact(octree);
+	REQUIRE_EQUAL(input.size(), compact.size());
+	REQUIRE_EQUAL(countNodes(octree), compact.getNodes().size());
+	REQUIRE(compact.getBox() == octree.getBox());
+	{
+		std::deque<IdPoint> actual;
+		compact.collectPoints(actual);
+		REQUIRE(getSortedIds(input) == getSortedIds(actual));
+	}
+	std::uniform_real_distribution<float> dist(0.0f, 0.5f);
+	for (uint32_t i = 0; i < 50; ++i) {
+		const Vec3f center = createRandomPosition(engine, -1.0f, 1.0f);
+		const float radius = dist(engine);
+		{
+			std::deque<IdPoint> actual;
+			compact.collectPointsWithinSphere(Sphere_f(center, radius), actual);
+			REQUIRE(getSortedIdsWithinRadius(input, center, radius) == getSortedIds(actual));
+		}
+		{
+			const Box queryBox(center, radius, radius * 0.5f, radius * 2.0f);
+			std::deque<IdPoint> actual;
+			compact.collectPointsWithinBox(queryBox, actual);
+			REQUIRE(getSortedIdsWithinBox(input, queryBox) == getSortedIds(actual));
+		}
+		const auto expected = getClosestDistancesSquared(input, center, 10);
+		{
+			const auto actual = compact.getSortedClosestPoints(center, 10);
+			REQUIRE_EQUAL(expected.size(), actual.size());
+			for (std::size_t j = 0; j < expected.size(); ++j) {
+				REQUIRE_EQUAL(expected[j], center.distanceSquared(actual[j].getPosition()));
+			}
+		}
+		{
+			std::deque<IdPoint> approximate;
+			compact.getApproximateClosestPoints(center, 10, 0.5f, approximate);
+			REQUIRE_EQUAL(expected.size(), approximate.size());
+			for (std::size_t j = 0; j < expected.size(); ++j) {
+				REQUIRE(center.distanceSquared(approximate[j].getPosition()) <= 2.25f * 1.0001f * expected[j]);
+			}
+		}
+	}
+	REQUIRE(compact.findLeafCell(Vec3f(2.0f, 0.0f, 0.0f)) == nullptr);
+	const auto * leaf = compact.findLeafCell(Vec3f(0.5f, 0.5f, 0.5f));
+	REQUIRE(leaf != nullptr);
+	REQUIRE(leaf->isLeaf());
+	REQUIRE(leaf->box.contains(Vec3f(0.5f, 0.5f, 0.5f)));
+}
+
+TEST_CASE("CompactPointOctreeTest_visitors", "[CompactPointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 10000, -1.0f, 1.0f);
+	const CompactPointOctree<IdPoint> compact(
+			PointOctree<IdPoint>(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8, input.begin(), input.end()));
+
+	CompactPointOctree<IdPoint>::traversal_stack_t stack;
+	const Sphere_f sphere(Vec3f(0.2f, 0.1f, -0.3f), 0.6f);
+	std::vector<uint32_t> visited;
+	REQUIRE(compact.visitPointsWithinSphere(sphere,
+											[&visited](const IdPoint & p) {
+												visited.push_back(p.id);
+												return true;
+											},
+											stack));
+	std::sort(visited.begin(), visited.end());
+	REQUIRE(getSortedIdsWithinRadius(input, sphere.getCenter(), sphere.getRadius()) == visited);
+
+	std::size_t count = 0;
+	REQUIRE(!compact.visitPointsWithinBox(Box(Vec3f(0.0f, 0.0f, 0.0f), 1.0f),
+										  [&count](const IdPoint &) { return ++count < 5; }, stack));
+	REQUIRE_EQUAL(static_cast<std::size_t>(5), count);
+	count = 0;
+	REQUIRE(compact.visitPoints([&count](const IdPoint &) { return ++count > 0; }));
+	REQUIRE_EQUAL(input.size(), count);
+}
+
+TEST_CASE("CompactPointOctreeTest_batchQueries", "[CompactPointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 10000, -1.0f, 1.0f);
+	const CompactPointOctree<IdPoint> compact(
+			PointOctree<IdPoint>(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8, input.begin(), input.end()));
+	const auto & points = compact.getPoints();
+
+	std::vector<Sphere_f> spheres;
+	std::vector<Box> boxes;
+	std::vector<Vec3f> positions;
+	for (uint32_t i = 0; i < 500; ++i) {
+		const Vec3f center = createRandomPosition(engine, -1.0f, 1.0f);
+		spheres.emplace_back(center, 0.1f);
+		boxes.emplace_back(center, 0.2f);
+		// some positions are outside of the tree, which gives no closest points
+		positions.push_back(i % 50 == 0 ? center + Vec3f(3.0f, 0.0f, 0.0f) : center);
+	}
+
+	for (unsigned int numThreads = 1; numThreads <= 4; numThreads += 3) {
+		CompactPointOctree<IdPoint>::BatchResult sphereResult, boxResult, closestResult;
+		compact.collectPointIndicesWithinSpheres(spheres, sphereResult, numThreads);
+		compact.collectPointIndicesWithinBoxes(boxes, boxResult, numThreads);
+		compact.getClosestPointIndices(positions, 5, closestResult, numThreads);
+		REQUIRE_EQUAL(spheres.size() + 1, sphereResult.offsets.size());
+		REQUIRE_EQUAL(boxes.size() + 1, boxResult.offsets.size());
+		REQUIRE_EQUAL(positions.size() + 1, closestResult.offsets.size());
+
+		for (std::size_t q = 0; q < spheres.size(); ++q) {
+			std::deque<IdPoint> expected;
+			compact.collectPointsWithinSphere(spheres[q], expected);
+			std::vector<IdPoint> actual;
+			for (uint32_t i = sphereResult.offsets[q]; i < sphereResult.offsets[q + 1]; ++i) {
+				actual.push_back(points[sphereResult.indices[i]]);
+			}
+			REQUIRE(getSortedIds(expected) == getSortedIds(actual));
+
+			expected.clear();
+			actual.clear();
+			compact.collectPointsWithinBox(boxes[q], expected);
+			for (uint32_t i = boxResult.offsets[q]; i < boxResult.offsets[q + 1]; ++i) {
+				actual.push_back(points[boxResult.indices[i]]);
+			}
+			REQUIRE(getSortedIds(expected) == getSortedIds(actual));
+
+			const auto closest = compact.getSortedClosestPoints(positions[q], 5);
+			REQUIRE_EQUAL(closest.size(), closestResult.offsets[q + 1] - closestResult.offsets[q]);
+			for (std::size_t i = 0; i < closest.size(); ++i) {
+				REQUIRE_EQUAL(closest[i].id, points[closestResult.indices[closestResult.offsets[q] + i]].id);
+			}
+		}
+	}
+}
+
+namespace {
+//! Point whose position cannot be accessed while @c failing is set.
+struct FailingPoint : public Geometry::Point<Geometry::Vec3f> {
+	static std::atomic<bool> failing;
+
+	explicit FailingPoint(const Geometry::Vec3f & pos) : Geometry::Point<Geometry::Vec3f>(pos) {
+	}
+	const Geometry::Vec3f & getPosition() const {
+		if (failing) {
+			throw std::runtime_error("FailingPoint: position is not available");
+		}
+		return Geometry::Point<Geometry::Vec3f>::getPosition();
+	}
+};
+std::atomic<bool> FailingPoint::failing(false);
+}
+
+TEST_CASE("CompactPointOctreeTest_batchQueryException", "[CompactPointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	std::vector<FailingPoint> input;
+	for (uint32_t i = 0; i < 10000; ++i) {
+		input.emplace_back(createRandomPosition(engine, -1.0f, 1.0f));
+	}
+	const CompactPointOctree<FailingPoint> compact(PointOctree<FailingPoint>(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f),
+																			 0.01f, 8, input.begin(), input.end()));
+	std::vector<Sphere_f> spheres;
+	std::vector<Vec3f> positions;
+	for (uint32_t i = 0; i < 1000; ++i) {
+		spheres.emplace_back(createRandomPosition(engine, -1.0f, 1.0f), 0.1f);
+		positions.push_back(spheres.back().getCenter());
+	}
+
+	// the exception of a worker is passed to the calling thread instead of terminating the process
+	CompactPointOctree<FailingPoint>::BatchResult expected, result;
+	compact.collectPointIndicesWithinSpheres(spheres, expected, 4);
+	FailingPoint::failing = true;
+	for (unsigned int numThreads = 1; numThreads <= 4; numThreads += 3) {
+		REQUIRE_THROWS_AS(compact.collectPointIndicesWithinSpheres(spheres, result, numThreads), std::runtime_error);
+		REQUIRE_THROWS_AS(compact.getClosestPointIndices(positions, 5, result, numThreads), std::runtime_error);
+	}
+	FailingPoint::failing = false;
+
+	// the tree stays usable
+	compact.collectPointIndicesWithinSpheres(spheres, result, 4);
+	REQUIRE(expected.offsets == result.offsets);
+	REQUIRE(expected.indices == result.indices);
+}
+
+TEST_CASE("CompactPointOctreeTest_positionArrays", "[CompactPointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	auto input = createRandomPoints(engine, 20000, -1.0f, 1.0f);
+	// points exactly on the query boundaries
+	input.emplace_back(Vec3f(0.0f, 0.0f, 0.0f), 20000);
+	input.emplace_back(Vec3f(0.25f, 0.0f, 0.0f), 20001);
+	const PointOctree<IdPoint> octree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 37, input.begin(),
+									  input.end());
+	const CompactPointOctree<IdPoint> scalar(octree);
+	const CompactPointOctree<IdPoint> vectorized(octree, true);
+	REQUIRE(!scalar.hasPositionArrays());
+	REQUIRE(vectorized.hasPositionArrays());
+
+	std::vector<Sphere_f> spheres{Sphere_f(Vec3f(0.0f, 0.0f, 0.0f), 0.25f)};
+	std::vector<Box> boxes{Box(0.0f, 0.25f, -0.5f, 0.0f, -0.1f, 0.0f)};
+	std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+	for (uint32_t i = 0; i < 100; ++i) {
+		const Vec3f center = createRandomPosition(engine, -1.0f, 1.0f);
+		spheres.emplace_back(center, 0.3f * dist(engine));
+		boxes.emplace_back(center, 0.5f * dist(engine), 0.3f, 0.1f);
+	}
+	for (std::size_t q = 0; q < spheres.size(); ++q) {
+		const auto expected = getSortedIdsWithinRadius(input, spheres[q].getCenter(), spheres[q].getRadius());
+		for (const auto * compact : {&scalar, &vectorized}) {
+			std::deque<IdPoint> actual;
+			compact->collectPointsWithinSphere(spheres[q], actual);
+			REQUIRE(expected == getSortedIds(actual));
+		}
+
+		const auto expectedInBox = getSortedIdsWithinBox(input, boxes[q]);
+		for (const auto * compact : {&scalar, &vectorized}) {
+			std::deque<IdPoint> actual;
+			compact->collectPointsWithinBox(boxes[q], actual);
+			REQUIRE(expectedInBox == getSortedIds(actual));
+		}
+	}
+
+	// early termination inside a vectorized leaf
+	std::size_t count = 0;
+	REQUIRE(!vectorized.visitPointsWithinSphere(Sphere_f(Vec3f(0.0f, 0.0f, 0.0f), 0.5f),
+												[&count](const IdPoint &) { return ++count < 3; }));
+	REQUIRE_EQUAL(static_cast<std::size_t>(3), count);
+}
+
+TEST_CASE("CompactPointOctreeTest_mappedFile", "[CompactPointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 10001, -1.0f, 1.0f);
+	const PointOctree<IdPoint> octree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8, input.begin(),
+									  input.end());
+	const std::string fileName("CompactPointOctreeTest_mappedFile.bin");
+
+	for (const bool storePositionArrays : {false, true}) {
+		const CompactPointOctree<IdPoint> original(octree, storePositionArrays);
+		original.saveToFile(fileName);
+		const CompactPointOctree<IdPoint> mapped = CompactPointOctree<IdPoint>::loadFromFile(fileName);
+		REQUIRE_EQUAL(storePositionArrays, mapped.hasPositionArrays());
+		REQUIRE_EQUAL(original.size(), mapped.size());
+		REQUIRE_EQUAL(original.getNodes().size(), mapped.getNodes().size());
+		REQUIRE_EQUAL(original.getMaxNumPoints(), mapped.getMaxNumPoints());
+		REQUIRE_EQUAL(original.getMinBoxSize(), mapped.getMinBoxSize());
+		REQUIRE(original.getBox() == mapped.getBox());
+		for (std::size_t i = 0; i < original.size(); ++i) {
+			REQUIRE_EQUAL(original.getPoints()[i].id, mapped.getPoints()[i].id);
+		}
+		for (uint32_t i = 0; i < 20; ++i) {
+			const Vec3f center = createRandomPosition(engine, -1.0f, 1.0f);
+			std::deque<IdPoint> expected, actual;
+			original.collectPointsWithinSphere(Sphere_f(center, 0.3f), expected);
+			mapped.collectPointsWithinSphere(Sphere_f(center, 0.3f), actual);
+			REQUIRE(getSortedIds(expected) == getSortedIds(actual));
+
+			expected.clear();
+			actual.clear();
+			original.collectPointsWithinBox(Box(center, 0.4f), expected);
+			mapped.collectPointsWithinBox(Box(center, 0.4f), actual);
+			REQUIRE(getSortedIds(expected) == getSortedIds(actual));
+
+			REQUIRE(getSortedIds(original.getSortedClosestPoints(center, 5))
+					== getSortedIds(mapped.getSortedClosestPoints(center, 5)));
+		}
+		// copies share the mapping, which outlives the original tree
+		CompactPointOctree<IdPoint> copy(original);
+		{
+			const CompactPointOctree<IdPoint> mappedCopy = CompactPointOctree<IdPoint>::loadFromFile(fileName);
+			copy = mappedCopy;
+		}
+		REQUIRE_EQUAL(original.size(), copy.size());
+		REQUIRE_EQUAL(original.getPoints().front().id, copy.getPoints().front().id);
+	}
+
+	// saving over a mapped file does not affect the trees mapping it
+	{
+		const CompactPointOctree<IdPoint> original(octree);
+		original.saveToFile(fileName);
+		const CompactPointOctree<IdPoint> mapped = CompactPointOctree<IdPoint>::loadFromFile(fileName);
+		const PointOctree<IdPoint> smallOctree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8, input.begin(),
+											   input.begin() + 10);
+		CompactPointOctree<IdPoint>(smallOctree).saveToFile(fileName);
+		REQUIRE_EQUAL(original.size(), mapped.size());
+		REQUIRE(getSortedIds(mapped.getPoints()) == getSortedIds(original.getPoints()));
+		REQUIRE_EQUAL(CompactPointOctree<IdPoint>::loadFromFile(fileName).size(), 10u);
+	}
+
+	// nodes with out of bounds point ranges or child indices are rejected
+	typedef CompactPointOctree<IdPoint>::Node Node;
+	const std::size_t nodeCountOffset = 40; // offsets of the header's nodeCount and nodeOffset
+	const std::size_t nodeOffsetOffset = 56;
+	const CompactPointOctree<IdPoint> original(octree);
+	const uint32_t invalidEnd = static_cast<uint32_t>(original.size() + 1);
+	original.saveToFile(fileName);
+	uint64_t nodeOffset = 0;
+	{
+		std::ifstream in(fileName.c_str(), std::ios::binary);
+		in.seekg(nodeOffsetOffset);
+		in.read(reinterpret_cast<char *>(&nodeOffset), sizeof(uint64_t));
+	}
+	REQUIRE_EQUAL(nodeOffset % 64, 0u);
+	patchFile(fileName, nodeOffset + offsetof(Node, end), &invalidEnd, sizeof(uint32_t));
+	REQUIRE_THROWS_AS(CompactPointOctree<IdPoint>::loadFromFile(fileName), std::runtime_error);
+	const uint32_t cyclicChild = 0;
+	original.saveToFile(fileName);
+	patchFile(fileName, nodeOffset + offsetof(Node, firstChild), &cyclicChild, sizeof(uint32_t));
+	REQUIRE_THROWS_AS(CompactPointOctree<IdPoint>::loadFromFile(fileName), std::runtime_error);
+	const uint32_t invalidChildCount = static_cast<uint32_t>(original.getNodes().size());
+	original.saveToFile(fileName);
+	patchFile(fileName, nodeOffset + offsetof(Node, childCount), &invalidChildCount, sizeof(uint32_t));
+	REQUIRE_THROWS_AS(CompactPointOctree<IdPoint>::loadFromFile(fileName), std::runtime_error);
+	// counts whose size in bytes overflows
+	const uint64_t hugeCount = (UINT64_C(1) << 63) / sizeof(Node) * 2 + 1;
+	original.saveToFile(fileName);
+	patchFile(fileName, nodeCountOffset, &hugeCount, sizeof(uint64_t));
+	REQUIRE_THROWS_AS(CompactPointOctree<IdPoint>::loadFromFile(fileName), std::runtime_error);
+
+	// files with another layout or a truncated content are rejected
+	{
+		std::ofstream out(fileName.c_str(), std::ios::binary | std::ios::trunc);
+		out << "GEOCPOT";
+	}
+	REQUIRE_THROWS_AS(CompactPointOctree<IdPoint>::loadFromFile(fileName), std::runtime_error);
+	std::remove(fileName.c_str());
+	REQUIRE_THROWS_AS(CompactPointOctree<IdPoint>::loadFromFile(fileName), std::runtime_error);
+}
@@ -0,0 +1,159 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include "ConcurrentPointOctree.h"
+#include "Point.h"
+#include "PointTestHelper.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <thread>
+#include <vector>
+#include <catch2/catch.hpp>
+#define REQUIRE_EQUAL(a,b) REQUIRE((a) == (b))
+
+using namespace PointTestHelper;
+
+TEST_CASE("ConcurrentPointOctreeTest_snapshots", "[ConcurrentPointOctreeTest]") {
+	using namespace Geometry;
+
+	const Box bounds(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+	ConcurrentPointOctree<IdPoint> octree(bounds, 0.01f, 8);
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 5000, -1.0f, 1.0f);
+	for (uint32_t i = 0; i < 2500; ++i) {
+		REQUIRE(octree.insert(input[i]));
+	}
+	REQUIRE(!octree.insert(IdPoint(Vec3f(2.0f, 0.0f, 0.0f), 0)));
+
+	const auto oldSnapshot = octree.getSnapshot();
+	for (uint32_t i = 2500; i < 5000; ++i) {
+		REQUIRE(octree.insert(input[i]));
+	}
+	std::vector<IdPoint> remaining;
+	for (uint32_t i = 0; i < 5000; ++i) {
+		if (i % 2 == 0) {
+			REQUIRE(octree.remove(input[i]));
+		} else {
+			remaining.push_back(input[i]);
+		}
+	}
+	REQUIRE(!octree.remove(input[0]));
+
+	// the old snapshot is unaffected by later modifications
+	REQUIRE_EQUAL(static_cast<std::size_t>(2500), oldSnapshot.size());
+	std::deque<IdPoint> points;
+	oldSnapshot.collectPoints(points);
+	REQUIRE(getSortedIds(std::vector<IdPoint>(input.begin(), input.begin() + 2500)) == getSortedIds(points));
+
+	const auto snapshot = octree.getSnapshot();
+	REQUIRE_EQUAL(remaining.size(), snapshot.size());
+	for (uint32_t i = 0; i < 20; ++i) {
+		const Sphere_f sphere(createRandomPosition(engine, -1.0f, 1.0f), 0.3f);
+		std::deque<IdPoint> actual;
+		snapshot.collectPointsWithinSphere(sphere, actual);
+		REQUIRE(getSortedIdsWithinRadius(remaining, sphere.getCenter(), sphere.getRadius()) == getSortedIds(actual));
+
+		const Box box(sphere.getCenter(), 0.5f);
+		actual.clear();
+		snapshot.collectPointsWithinBox(box, actual);
+		REQUIRE(getSortedIdsWithinBox(remaining, box) == getSortedIds(actual));
+	}
+
+	octree.clear();
+	REQUIRE(octree.getSnapshot().empty());
+	REQUIRE_EQUAL(static_cast<std::size_t>(2500), snapshot.size());
+}
+
+namespace {
+//! Point counting its living instances.
+struct CountedPoint : public Geometry::Point<Geometry::Vec3f> {
+	static std::atomic<int> instances;
+
+	explicit CountedPoint(const Geometry::Vec3f & pos) : Geometry::Point<Geometry::Vec3f>(pos) {
+		++instances;
+	}
+	CountedPoint(const CountedPoint & other) : Geometry::Point<Geometry::Vec3f>(other) {
+		++instances;
+	}
+	CountedPoint & operator=(const CountedPoint &) = default;
+	~CountedPoint() {
+		--instances;
+	}
+};
+std::atomic<int> CountedPoint::instances(0);
+}
+
+TEST_CASE("ConcurrentPointOctreeTest_reclamation", "[ConcurrentPointOctreeTest]") {
+	using namespace Geometry;
+
+	{
+		ConcurrentPointOctree<CountedPoint> octree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8);
+		std::default_random_engine engine;
+		for (uint32_t i = 0; i < 100; ++i) {
+			octree.insert(CountedPoint(createRandomPosition(engine, -1.0f, 1.0f)));
+		}
+		// without snapshots, replaced versions are released immediately
+		REQUIRE_EQUAL(100, CountedPoint::instances.load());
+		{
+			const auto snapshot = octree.getSnapshot();
+			auto copy = octree.getSnapshot();
+			copy = snapshot;
+			octree.clear();
+			octree.insert(CountedPoint(Vec3f(0.0f, 0.0f, 0.0f)));
+			// the version of the snapshots is kept
+			REQUIRE_EQUAL(101, CountedPoint::instances.load());
+			REQUIRE_EQUAL(static_cast<std::size_t>(100), copy.size());
+		}
+		// released by the next modification
+		octree.insert(CountedPoint(Vec3f(0.5f, 0.5f, 0.5f)));
+		REQUIRE_EQUAL(2, CountedPoint::instances.load());
+	}
+	REQUIRE_EQUAL(0, CountedPoint::instances.load());
+}
+
+TEST_CASE("ConcurrentPointOctreeTest_concurrentReaders", "[ConcurrentPointOctreeTest]") {
+	using namespace Geometry;
+
+	ConcurrentPointOctree<IdPoint> octree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8);
+	std::atomic<bool> writerDone(false);
+	std::atomic<uint32_t> inconsistentSnapshots(0);
+
+	std::vector<std::thread> readers;
+	for (uint32_t r = 0; r < 3; ++r) {
+		readers.emplace_back([&]() {
+			std::size_t lastSize = 0;
+			while (!writerDone) {
+				const auto snapshot = octree.getSnapshot();
+				const auto copy = snapshot;
+				std::size_t count = 0;
+				snapshot.visitPoints([&count](const IdPoint &) { return ++count > 0; });
+				// snapshots are consistent and the writer only inserts
+				if (count != snapshot.size() || count != copy.size() || count < lastSize) {
+					++inconsistentSnapshots;
+				}
+				lastSize = count;
+			}
+		});
+	}
+	std::default_random_engine engine;
+	for (const auto & point : createRandomPoints(engine, 5000, -1.0f, 1.0f)) {
+		octree.insert(point);
+	}
+	writerDone = true;
+	for (auto & reader : readers) {
+		reader.join();
+	}
+	REQUIRE_EQUAL(0u, inconsistentSnapshots.load());
+	REQUIRE_EQUAL(static_cast<std::size_t>(5000), octree.getSnapshot().size());
+}
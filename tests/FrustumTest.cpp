@@ -66,3 +66,28 @@ TEST_CASE("FrustumTest_testFrustumTest", "[FrustumTest]") {
 	REQUIRE(Geometry::Frustum::intersection_t::OUTSIDE ==
 						 frustum.isBoxInFrustum(Geometry::Box(-1.0f, 1.0f, -1.0f, 1.0f, 10.5f, 11.5f)));
 }
+
+TEST_CASE("FrustumTest_testPlaneMask", "[FrustumTest]") {
+	Geometry::Frustum frustum;
+	frustum.setPerspective(Geometry::Angle::deg(90.0f), 1.0f, 1.0f, 10.0f);
+
+	// Box intersecting only one side plane.
+	uint8_t planeMask = 0x3f;
+	REQUIRE(Geometry::Frustum::intersection_t::INTERSECT ==
+						 frustum.isBoxInFrustum(Geometry::Box(-7.0f, -5.0f, -1.0f, 1.0f, 5.0f, 7.0f), planeMask));
+	REQUIRE(planeMask != 0);
+	REQUIRE((planeMask & (planeMask - 1)) == 0);
+	// A contained box inside that plane needs no further tests.
+	REQUIRE(Geometry::Frustum::intersection_t::INSIDE ==
+						 frustum.isBoxInFrustum(Geometry::Box(-5.5f, -5.0f, -1.0f, 1.0f, 6.5f, 7.0f), planeMask));
+	REQUIRE(planeMask == 0);
+	// Planes missing from the mask are ignored.
+	planeMask = 0;
+	REQUIRE(Geometry::Frustum::intersection_t::INSIDE ==
+						 frustum.isBoxInFrustum(Geometry::Box(-9.5f, -7.5f, -1.0f, 1.0f, 5.0f, 7.0f), planeMask));
+	// The mask is not changed if the box is outside.
+	planeMask = 0x3f;
+	REQUIRE(Geometry::Frustum::intersection_t::OUTSIDE ==
+						 frustum.isBoxInFrustum(Geometry::Box(-9.5f, -7.5f, -1.0f, 1.0f, 5.0f, 7.0f), planeMask));
+	REQUIRE(planeMask == 0x3f);
+}
@@ -0,0 +1,121 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include "Morton.h"
+#include "MortonPointIndex.h"
+#include "PointTestHelper.h"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+#include <catch2/catch.hpp>
+#define REQUIRE_EQUAL(a,b) REQUIRE((a) == (b))
+
+using namespace PointTestHelper;
+
+namespace {
+uint64_t interleave(uint32_t x, uint32_t y, uint32_t z, uint32_t bits) {
+	uint64_t code = 0;
+	for (uint32_t bit = 0; bit < bits; ++bit) {
+		code |= (uint64_t((x >> bit) & 1) << (3 * bit)) | (uint64_t((y >> bit) & 1) << (3 * bit + 1))
+				| (uint64_t((z >> bit) & 1) << (3 * bit + 2));
+	}
+	return code;
+}
+}
+
+TEST_CASE("MortonTest_encodeDecode", "[MortonTest]") {
+	using namespace Geometry;
+
+	REQUIRE_EQUAL(1u, Morton::encode32(1, 0, 0));
+	REQUIRE_EQUAL(2u, Morton::encode32(0, 1, 0));
+	REQUIRE_EQUAL(4u, Morton::encode32(0, 0, 1));
+	REQUIRE_EQUAL(63u, Morton::encode32(3, 3, 3));
+	REQUIRE_EQUAL(0x3fffffffu, Morton::encode32(1023, 1023, 1023));
+	REQUIRE_EQUAL(0x7fffffffffffffffull, Morton::encode64(0x1fffff, 0x1fffff, 0x1fffff));
+
+	std::default_random_engine engine;
+	std::uniform_int_distribution<uint32_t> dist10(0, 1023);
+	std::uniform_int_distribution<uint32_t> dist21(0, 0x1fffff);
+	for (uint32_t i = 0; i < 10000; ++i) {
+		const uint32_t x = dist10(engine), y = dist10(engine), z = dist10(engine);
+		const uint32_t code32 = Morton::encode32(x, y, z);
+		REQUIRE_EQUAL(interleave(x, y, z, 10), static_cast<uint64_t>(code32));
+		uint32_t dx, dy, dz;
+		Morton::decode32(code32, dx, dy, dz);
+		REQUIRE_EQUAL(x, dx);
+		REQUIRE_EQUAL(y, dy);
+		REQUIRE_EQUAL(z, dz);
+
+		const uint32_t u = dist21(engine), v = dist21(engine), w = dist21(engine);
+		const uint64_t code64 = Morton::encode64(u, v, w);
+		REQUIRE_EQUAL(interleave(u, v, w, 21), code64);
+		Morton::decode64(code64, dx, dy, dz);
+		REQUIRE_EQUAL(u, dx);
+		REQUIRE_EQUAL(v, dy);
+		REQUIRE_EQUAL(w, dz);
+	}
+}
+
+TEST_CASE("MortonTest_pointIndex", "[MortonTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	auto input = createRandomPoints(engine, 20000, -10.0f, 10.0f);
+	// points outside of the bounds have to be found as well
+	input.emplace_back(Vec3f(12.0f, 0.0f, 0.0f), 20000);
+	input.emplace_back(Vec3f(-11.0f, -11.0f, -11.0f), 20001);
+
+	const Box bounds(-10.0f, 10.0f, -10.0f, 10.0f, -10.0f, 10.0f);
+	const MortonPointIndex<IdPoint> index(bounds, input.begin(), input.end());
+	REQUIRE_EQUAL(input.size(), index.size());
+	REQUIRE(std::is_sorted(index.getCodes().begin(), index.getCodes().end()));
+	for (std::size_t i = 0; i < index.size(); ++i) {
+		REQUIRE_EQUAL(index.getCode(index.getPoints()[i].getPosition()), index.getCodes()[i]);
+	}
+	REQUIRE(getSortedIds(input) == getSortedIds(index.getPoints()));
+
+	std::vector<MortonPointIndex<IdPoint>::KeyInterval> intervals;
+	std::uniform_real_distribution<float> sizeDist(0.0f, 8.0f);
+	for (uint32_t q = 0; q < 100; ++q) {
+		const Vec3f center = createRandomPosition(engine, -10.0f, 10.0f);
+		Box queryBox(center, sizeDist(engine));
+		if (q == 0) {
+			queryBox = Box(11.0f, 13.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+		}
+
+		index.getKeyIntervals(queryBox, intervals, 32);
+		REQUIRE(!intervals.empty());
+		REQUIRE(intervals.size() <= 32);
+		for (std::size_t i = 0; i < intervals.size(); ++i) {
+			REQUIRE(intervals[i].first <= intervals[i].last);
+			if (i > 0) {
+				REQUIRE(intervals[i - 1].last < intervals[i].first);
+			}
+		}
+
+		std::vector<uint32_t> found;
+		index.visitPointsWithinBox(queryBox, [&found](const IdPoint & p) {
+			found.push_back(p.id);
+			return true;
+		}, intervals);
+		std::sort(found.begin(), found.end());
+		REQUIRE(getSortedIdsWithinBox(input, queryBox) == found);
+	}
+
+	std::deque<IdPoint> collected;
+	index.collectPointsWithinBox(bounds, collected);
+	REQUIRE(getSortedIdsWithinBox(input, bounds) == getSortedIds(collected));
+	uint32_t visited = 0;
+	REQUIRE(!index.visitPoints([&visited](const IdPoint &) { return ++visited < 10; }));
+	REQUIRE_EQUAL(10u, visited);
+}
@@ -0,0 +1,200 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include "OutOfCorePointOctree.h"
+#include "PointTestHelper.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+#define REQUIRE_EQUAL(a,b) REQUIRE((a) == (b))
+
+using namespace PointTestHelper;
+
+TEST_CASE("OutOfCorePointOctreeTest_queries", "[OutOfCorePointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	std::vector<IdPoint> input;
+	for (uint32_t i = 0; i < 30000; ++i) {
+		// dense cluster around the origin and a sparse remainder
+		const float scale = (i % 4 == 0) ? 1.0f : 0.2f;
+		input.emplace_back(createRandomPosition(engine, -scale, scale), i);
+	}
+	input.emplace_back(Vec3f(5.0f, 0.0f, 0.0f), 30000); // outside
+	const Box bounds(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+	const std::string prefix("OutOfCorePointOctreeTest_queries");
+	{
+		// small buffers force many partial writes and bucket splits
+		OutOfCorePointOctree<IdPoint>::Builder builder(prefix, bounds, 0.01f, 8, 2000, 4096);
+		REQUIRE_EQUAL(input.size() - 1, builder.insert(input.begin(), input.end()));
+		builder.finish();
+		REQUIRE(!builder.insert(input.front()));
+	}
+	const std::size_t budget = 3 * 2000 * sizeof(IdPoint);
+	const OutOfCorePointOctree<IdPoint> octree(prefix, budget);
+	REQUIRE_EQUAL(static_cast<uint64_t>(input.size() - 1), octree.size());
+	REQUIRE(octree.getBox() == bounds);
+	REQUIRE(octree.getNumChunks() > 10);
+	REQUIRE_EQUAL(static_cast<std::size_t>(0), octree.getNumResidentChunks());
+	{
+		std::deque<IdPoint> actual;
+		octree.collectPoints(actual);
+		REQUIRE(getSortedIdsWithinBox(input, bounds) == getSortedIds(actual));
+		REQUIRE(octree.getResidentBytes() <= budget);
+		REQUIRE_EQUAL(static_cast<uint64_t>(octree.getNumChunks()), octree.getNumChunkLoads());
+	}
+	std::uniform_real_distribution<float> dist(0.0f, 0.4f);
+	for (uint32_t i = 0; i < 30; ++i) {
+		const Vec3f center = createRandomPosition(engine, -1.0f, 1.0f);
+		const float radius = dist(engine);
+		std::deque<IdPoint> actual;
+		octree.collectPointsWithinSphere(Sphere_f(center, radius), actual);
+		REQUIRE(getSortedIdsWithinRadius(input, center, radius) == getSortedIds(actual));
+
+		actual.clear();
+		octree.collectPointsWithinBox(Box(center, radius), actual);
+		REQUIRE(getSortedIdsWithinBox(input, Box(center, radius)) == getSortedIds(actual));
+		REQUIRE(octree.getResidentBytes() <= budget);
+	}
+
+	// a small query loads only the chunks it touches; repeating it hits the cache
+	octree.clearCache();
+	const uint64_t loadsBefore = octree.getNumChunkLoads();
+	const Box smallBox(Vec3f(0.9f, 0.9f, 0.9f), 0.05f);
+	std::deque<IdPoint> found;
+	octree.collectPointsWithinBox(smallBox, found);
+	const uint64_t loads = octree.getNumChunkLoads() - loadsBefore;
+	REQUIRE(loads >= 1);
+	REQUIRE(loads < 4);
+	octree.collectPointsWithinBox(smallBox, found);
+	REQUIRE_EQUAL(loadsBefore + loads, octree.getNumChunkLoads());
+
+	// early termination
+	std::size_t count = 0;
+	REQUIRE(!octree.visitPoints([&count](const IdPoint &) { return ++count < 10; }));
+	REQUIRE_EQUAL(static_cast<std::size_t>(10), count);
+
+	std::remove((prefix + ".index").c_str());
+	for (uint32_t i = 0; i < octree.getNumChunks(); ++i) {
+		std::remove((prefix + ".chunk" + std::to_string(i)).c_str());
+	}
+	REQUIRE_THROWS_AS(OutOfCorePointOctree<IdPoint>(prefix, budget), std::runtime_error);
+}
+
+TEST_CASE("OutOfCorePointOctreeTest_corruptIndex", "[OutOfCorePointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 5000, -1.0f, 1.0f);
+	const std::string prefix("OutOfCorePointOctreeTest_corruptIndex");
+	const std::string fileName = prefix + ".index";
+	const auto build = [&]() {
+		OutOfCorePointOctree<IdPoint>::Builder builder(prefix, Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8,
+														1000, 4096);
+		builder.insert(input.begin(), input.end());
+		builder.finish();
+	};
+	build();
+	const std::size_t budget = 1 << 20;
+	const uint32_t chunkCount = OutOfCorePointOctree<IdPoint>(prefix, budget).getNumChunks();
+	REQUIRE(chunkCount > 1);
+
+	// offsets of the header's nodeCount and of the members of the nodes, which follow the header
+	const std::size_t nodeCountOffset = 32;
+	const std::size_t headerSize = 40;
+	const std::size_t nodeSize = 48;
+	const std::size_t firstChildOffset = 24;
+	const std::size_t childCountOffset = 28;
+	const std::size_t chunkOffset = 32;
+	uint64_t nodeCount = 0;
+	std::size_t leaf = 0; // a node referring to a chunk
+	{
+		std::ifstream in(fileName.c_str(), std::ios::binary);
+		in.seekg(nodeCountOffset);
+		in.read(reinterpret_cast<char *>(&nodeCount), sizeof(uint64_t));
+		for (std::size_t i = 0; i < nodeCount && leaf == 0; ++i) {
+			uint32_t chunk = 0;
+			in.seekg(static_cast<std::streamoff>(headerSize + i * nodeSize + chunkOffset));
+			in.read(reinterpret_cast<char *>(&chunk), sizeof(uint32_t));
+			leaf = (chunk < chunkCount) ? i : 0;
+		}
+	}
+	REQUIRE(nodeCount > 1);
+	REQUIRE(leaf != 0);
+
+	// nodes with cyclic or out of bounds children and unknown chunks are rejected
+	const uint32_t cyclicChild = 0;
+	patchFile(fileName, headerSize + firstChildOffset, &cyclicChild, sizeof(uint32_t));
+	REQUIRE_THROWS_AS(OutOfCorePointOctree<IdPoint>(prefix, budget), std::runtime_error);
+	build();
+	const uint32_t invalidChildCount = static_cast<uint32_t>(nodeCount);
+	patchFile(fileName, headerSize + childCountOffset, &invalidChildCount, sizeof(uint32_t));
+	REQUIRE_THROWS_AS(OutOfCorePointOctree<IdPoint>(prefix, budget), std::runtime_error);
+	build();
+	patchFile(fileName, headerSize + leaf * nodeSize + chunkOffset, &chunkCount, sizeof(uint32_t));
+	REQUIRE_THROWS_AS(OutOfCorePointOctree<IdPoint>(prefix, budget), std::runtime_error);
+	// node counts beyond the file size, also if their size in bytes overflows
+	for (const uint64_t invalidNodeCount : {nodeCount + 1, (UINT64_C(1) << 63) / nodeSize * 2 + 1}) {
+		build();
+		patchFile(fileName, nodeCountOffset, &invalidNodeCount, sizeof(uint64_t));
+		REQUIRE_THROWS_AS(OutOfCorePointOctree<IdPoint>(prefix, budget), std::runtime_error);
+	}
+
+	build();
+	std::deque<IdPoint> all;
+	OutOfCorePointOctree<IdPoint>(prefix, budget).collectPoints(all);
+	REQUIRE_EQUAL(input.size(), all.size());
+	std::remove(fileName.c_str());
+	for (uint32_t i = 0; i < chunkCount; ++i) {
+		std::remove((prefix + ".chunk" + std::to_string(i)).c_str());
+	}
+}
+
+TEST_CASE("OutOfCorePointOctreeTest_rebuild", "[OutOfCorePointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 5000, -1.0f, 1.0f);
+	const std::string prefix("OutOfCorePointOctreeTest_rebuild");
+	const std::size_t budget = 1 << 20;
+	const auto build = [&](std::size_t count) {
+		OutOfCorePointOctree<IdPoint>::Builder builder(prefix, Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8,
+														1000, 4096);
+		builder.insert(input.begin(), input.begin() + count);
+		builder.finish();
+		return OutOfCorePointOctree<IdPoint>(prefix, budget).getNumChunks();
+	};
+	const auto chunkExists = [&prefix](uint32_t chunk) {
+		return std::ifstream((prefix + ".chunk" + std::to_string(chunk)).c_str()).good();
+	};
+
+	// a smaller tree with the same prefix removes the chunks it does not replace
+	const uint32_t chunkCount = build(input.size());
+	REQUIRE(chunkCount > 1);
+	REQUIRE(chunkExists(chunkCount - 1));
+	REQUIRE_EQUAL(1u, build(100));
+	REQUIRE(chunkExists(0));
+	for (uint32_t i = 1; i < chunkCount; ++i) {
+		REQUIRE_FALSE(chunkExists(i));
+	}
+	std::deque<IdPoint> all;
+	OutOfCorePointOctree<IdPoint>(prefix, budget).collectPoints(all);
+	REQUIRE_EQUAL(static_cast<std::size_t>(100), all.size());
+	std::remove((prefix + ".index").c_str());
+	std::remove((prefix + ".chunk0").c_str());
+}
@@ -9,13 +9,21 @@
 */
 #include "Point.h"
 #include "PointOctree.h"
+#include "PointTestHelper.h"
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <deque>
 #include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 #include <catch2/catch.hpp>
 #define REQUIRE_EQUAL(a,b) REQUIRE((a) == (b))
 #define REQUIRE_DOUBLES_EQUAL(a,b,e) REQUIRE((((a) <= (b) + e) && ((b) <= (a) + e)))
 
+using namespace PointTestHelper;
+
 struct CharPoint : public Geometry::Point<Geometry::Vec3f> {
 	char data;
 
@@ -134,3 +142,688 @@ TEST_CASE("PointOctreeTest_test", "[PointOctreeTest]") {
 		}
 	}
 }
+
+static bool isSameStructure(const Geometry::PointOctree<IdPoint> & a, const Geometry::PointOctree<IdPoint> & b) {
+	if (!(a.getBox() == b.getBox()) || a.getChildren().size() != b.getChildren().size()
+			|| a.getPoints().size() != b.getPoints().size()) {
+		return false;
+	}
+	for (std::size_t i = 0; i < a.getPoints().size(); ++i) {
+		if (a.getPoints()[i].id != b.getPoints()[i].id) {
+			return false;
+		}
+	}
+	for (std::size_t i = 0; i < a.getChildren().size(); ++i) {
+		if (!isSameStructure(a.getChildren()[i], b.getChildren()[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+TEST_CASE("PointOctreeTest_bulkLoad", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	std::vector<IdPoint> input;
+	for (uint32_t i = 0; i < 50000; ++i) {
+		const Vec3f pos = createRandomPosition(engine, -1.2f, 1.2f);
+		input.emplace_back(Vec3f(pos.x(), pos.y(), 0.1f * pos.z()), i);
+	}
+	// duplicates force splitting down to the minimum box size
+	for (uint32_t i = 0; i < 40; ++i) {
+		input.emplace_back(Vec3f(0.25f, 0.25f, 0.0f), 50000 + i);
+	}
+
+	const Box bounds(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+	PointOctree<IdPoint> incremental(bounds, 0.01f, 16);
+	for (const auto & p : input) {
+		incremental.insert(p);
+	}
+	const PointOctree<IdPoint> bulk(bounds, 0.01f, 16, input.begin(), input.end());
+	REQUIRE(isSameStructure(incremental, bulk));
+
+	const std::deque<IdPoint> inputDeque(input.begin(), input.begin() + 5);
+	const PointOctree<IdPoint> small(bounds, 0.01f, 16, inputDeque.begin(), inputDeque.end());
+	REQUIRE(small.isLeaf());
+	REQUIRE(small.getPoints().size() <= 5);
+}
+
+TEST_CASE("PointOctreeTest_parallelBulkLoad", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 100000, -1.0f, 1.0f);
+
+	const Box bounds(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+	const PointOctree<IdPoint> sequential(bounds, 0.01f, 16, input.begin(), input.end());
+	for (unsigned int numThreads = 1; numThreads <= 4; ++numThreads) {
+		const PointOctree<IdPoint> parallel(bounds, 0.01f, 16, input.begin(), input.end(), numThreads, 500);
+		REQUIRE(isSameStructure(sequential, parallel));
+	}
+	const PointOctree<IdPoint> automatic(bounds, 0.01f, 16, input.begin(), input.end(), 0);
+	REQUIRE(isSameStructure(sequential, automatic));
+}
+
+//! Point whose copy constructor throws after a given number of copies.
+struct ThrowingPoint : public Geometry::Point<Geometry::Vec3f> {
+	static std::atomic<int> copiesLeft;
+
+	explicit ThrowingPoint(const Geometry::Vec3f & pos) : Geometry::Point<Geometry::Vec3f>(pos) {
+	}
+	ThrowingPoint(const ThrowingPoint & other) : Geometry::Point<Geometry::Vec3f>(other) {
+		if (--copiesLeft < 0) {
+			throw std::runtime_error("ThrowingPoint: copy failed");
+		}
+	}
+	ThrowingPoint & operator=(const ThrowingPoint &) = default;
+};
+std::atomic<int> ThrowingPoint::copiesLeft(0);
+
+TEST_CASE("PointOctreeTest_parallelBulkLoadException", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	std::vector<ThrowingPoint> input;
+	input.reserve(100000);
+	for (uint32_t i = 0; i < 100000; ++i) {
+		input.emplace_back(createRandomPosition(engine, -1.0f, 1.0f));
+	}
+
+	// the exception of a worker is passed to the caller after all threads have been joined
+	const Box bounds(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+	ThrowingPoint::copiesLeft = 50000;
+	REQUIRE_THROWS_AS(PointOctree<ThrowingPoint>(bounds, 0.01f, 16, input.begin(), input.end(), 4, 500),
+					  std::runtime_error);
+	ThrowingPoint::copiesLeft = 1000000;
+	const PointOctree<ThrowingPoint> octree(bounds, 0.01f, 16, input.begin(), input.end(), 4, 500);
+	std::deque<ThrowingPoint> points;
+	octree.collectPoints(points);
+	REQUIRE_EQUAL(points.size(), input.size());
+}
+
+TEST_CASE("PointOctreeTest_closestPoints", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	std::vector<IdPoint> input;
+	for (uint32_t i = 0; i < 20000; ++i) {
+		// dense cluster around the origin and a sparse remainder
+		const float scale = (i % 10 == 0) ? 1.0f : 0.1f;
+		input.emplace_back(createRandomPosition(engine, -scale, scale), i);
+	}
+	const PointOctree<IdPoint> octree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.001f, 8, input.begin(),
+									  input.end());
+
+	for (uint32_t i = 0; i < 100; ++i) {
+		const Vec3f pos = createRandomPosition(engine, -1.0f, 1.0f);
+		const uint64_t count = 1 + i % 25;
+		const auto expected = getClosestDistancesSquared(input, pos, count);
+
+		const auto closest = octree.getSortedClosestPoints(pos, count);
+		REQUIRE_EQUAL(count, closest.size());
+		for (std::size_t j = 0; j < closest.size(); ++j) {
+			REQUIRE_EQUAL(expected[j], pos.distanceSquared(closest[j].getPosition()));
+		}
+
+		std::deque<IdPoint> approximate;
+		octree.getApproximateClosestPoints(pos, count, 0.0f, approximate);
+		REQUIRE_EQUAL(count, approximate.size());
+		for (std::size_t j = 0; j < approximate.size(); ++j) {
+			REQUIRE_EQUAL(expected[j], pos.distanceSquared(approximate[j].getPosition()));
+		}
+		for (const float epsilon : {0.1f, 0.5f, 2.0f}) {
+			octree.getApproximateClosestPoints(pos, count, epsilon, approximate);
+			REQUIRE_EQUAL(count, approximate.size());
+			const float bound = (1.0f + epsilon) * (1.0f + epsilon) * 1.0001f;
+			for (std::size_t j = 0; j < approximate.size(); ++j) {
+				REQUIRE(pos.distanceSquared(approximate[j].getPosition()) <= expected[j] * bound);
+			}
+		}
+	}
+	{
+		std::deque<IdPoint> out;
+		REQUIRE_THROWS_AS(octree.getApproximateClosestPoints(Vec3f(0.0f, 0.0f, 0.0f), 5, -0.5f, out),
+						  std::invalid_argument);
+	}
+	{
+		std::deque<IdPoint> out;
+		octree.getClosestPoints(Vec3f(0.0f, 0.0f, 0.0f), 0, out);
+		REQUIRE(out.empty());
+		octree.getClosestPoints(Vec3f(0.0f, 0.0f, 0.0f), 30000, out);
+		REQUIRE_EQUAL(input.size(), out.size());
+	}
+}
+
+TEST_CASE("PointOctreeTest_visitors", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 10000, -1.0f, 1.0f);
+	const PointOctree<IdPoint> octree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8, input.begin(),
+									  input.end());
+
+	PointOctree<IdPoint>::traversal_stack_t stack;
+	const Sphere_f sphere(Vec3f(0.2f, 0.1f, -0.3f), 0.6f);
+	const Box box(Vec3f(-0.2f, 0.3f, 0.0f), 0.9f);
+	{
+		std::vector<IdPoint> visited;
+		REQUIRE(octree.visitPointsWithinSphere(sphere,
+											   [&visited](const IdPoint & p) {
+												   visited.push_back(p);
+												   return true;
+											   },
+											   stack));
+		REQUIRE(getSortedIdsWithinRadius(input, sphere.getCenter(), sphere.getRadius()) == getSortedIds(visited));
+	}
+	{
+		std::vector<IdPoint> visited;
+		REQUIRE(octree.visitPointsWithinBox(box,
+											[&visited](const IdPoint & p) {
+												visited.push_back(p);
+												return true;
+											},
+											stack));
+		REQUIRE(getSortedIdsWithinBox(input, box) == getSortedIds(visited));
+	}
+	{
+		// stop early
+		std::size_t visited = 0;
+		const auto stopAfterTen = [&visited](const IdPoint &) { return ++visited < 10; };
+		REQUIRE(!octree.visitPointsWithinBox(box, stopAfterTen, stack));
+		REQUIRE_EQUAL(static_cast<std::size_t>(10), visited);
+		visited = 0;
+		REQUIRE(!octree.visitPointsWithinSphere(sphere, stopAfterTen, stack));
+		REQUIRE_EQUAL(static_cast<std::size_t>(10), visited);
+		visited = 0;
+		REQUIRE(!octree.visitPoints(stopAfterTen, stack));
+		REQUIRE_EQUAL(static_cast<std::size_t>(10), visited);
+	}
+	{
+		// queries without results do not need to grow a reused stack
+		const std::size_t capacity = stack.capacity();
+		const auto * data = stack.data();
+		REQUIRE(octree.visitPointsWithinBox(Box(Vec3f(5.0f, 5.0f, 5.0f), 1.0f), [](const IdPoint &) { return true; },
+											stack));
+		REQUIRE_EQUAL(capacity, stack.capacity());
+		REQUIRE(data == stack.data());
+	}
+}
+
+static bool hasMergeableCells(const Geometry::PointOctree<IdPoint> & cell) {
+	if (cell.isLeaf()) {
+		return false;
+	}
+	std::size_t count = 0;
+	bool onlyLeaves = true;
+	for (const auto & child : cell.getChildren()) {
+		if (hasMergeableCells(child)) {
+			return true;
+		}
+		onlyLeaves = onlyLeaves && child.isLeaf();
+		count += child.getPoints().size();
+	}
+	return onlyLeaves && count < cell.getMaxNumPoints();
+}
+
+TEST_CASE("PointOctreeTest_removeIf", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 20000, -1.0f, 1.0f);
+	PointOctree<IdPoint> octree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8, input.begin(), input.end());
+
+	const Box region(Vec3f(0.2f, -0.1f, 0.3f), 0.8f);
+	const auto isOdd = [](const IdPoint & p) { return p.id % 2 == 1; };
+	const auto isRemoved = [&](const IdPoint & p) { return region.contains(p.getPosition()) && isOdd(p); };
+	REQUIRE_EQUAL(getSortedIdsIf(input, isRemoved).size(), octree.removeIf(isOdd, region));
+	REQUIRE_EQUAL(static_cast<std::size_t>(0), octree.removeIf(isOdd, region));
+	{
+		std::deque<IdPoint> remaining;
+		octree.collectPoints(remaining);
+		REQUIRE(getSortedIdsIf(input, [&](const IdPoint & p) { return !isRemoved(p); }) == getSortedIds(remaining));
+	}
+
+	// remove everything in a few bulk steps; the tree has to collapse completely
+	REQUIRE(octree.removeIf([](const IdPoint & p) { return p.id < 10000; }) > 0);
+	REQUIRE(!hasMergeableCells(octree));
+	REQUIRE(octree.removeIf([](const IdPoint &) { return true; }) > 0);
+	REQUIRE(octree.empty());
+
+	// single removals keep the tree merged
+	PointOctree<IdPoint> octree2(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8, input.begin(), input.end());
+	for (uint32_t i = 0; i < 19000; ++i) {
+		REQUIRE(octree2.remove(input[i]));
+	}
+	REQUIRE(!hasMergeableCells(octree2));
+	std::deque<IdPoint> remaining;
+	octree2.collectPoints(remaining);
+	REQUIRE_EQUAL(static_cast<std::size_t>(1000), remaining.size());
+}
+
+TEST_CASE("PointOctreeTest_rayQueries", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 20000, -1.0f, 1.0f);
+	const PointOctree<IdPoint> octree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8, input.begin(),
+									  input.end());
+
+	const auto getParam = [](const Vec3f & origin, const Vec3f & dir, float maxParam, const Vec3f & pos,
+							 float & distSquared) {
+		const float param = std::max(0.0f, std::min(dir.dot(pos - origin), maxParam));
+		distSquared = (origin + dir * param).distanceSquared(pos);
+		return param;
+	};
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+	for (uint32_t i = 0; i < 100; ++i) {
+		// origins inside and outside of the octree
+		const Vec3f origin = createRandomPosition(engine, -2.0f, 2.0f);
+		Vec3f dir = createRandomPosition(engine, -1.0f, 1.0f);
+		if (i % 10 == 0) {
+			dir = Vec3f(dist(engine), 0.0f, 0.0f); // axis-parallel ray
+		}
+		dir.normalize();
+		const float radius = 0.05f * std::abs(dist(engine));
+		const Ray3f ray(origin, dir);
+		const Segment3f segment(origin, origin + dir * 1.5f);
+
+		for (const float maxParam : {ray.getMaxParam(), segment.getMaxParam()}) {
+			std::vector<uint32_t> expected;
+			const IdPoint * expectedFirst = nullptr;
+			float expectedFirstParam = 0.0f;
+			for (const auto & p : input) {
+				float distSquared;
+				const float param = getParam(origin, dir, maxParam, p.getPosition(), distSquared);
+				if (distSquared <= radius * radius) {
+					expected.push_back(p.id);
+					if (expectedFirst == nullptr || param < expectedFirstParam) {
+						expectedFirst = &p;
+						expectedFirstParam = param;
+					}
+				}
+			}
+			std::sort(expected.begin(), expected.end());
+
+			std::deque<IdPoint> actual;
+			const IdPoint * actualFirst;
+			if (maxParam == ray.getMaxParam()) {
+				octree.collectPointsNearRay(ray, radius, actual);
+				actualFirst = octree.findFirstPointAlongRay(ray, radius);
+			} else {
+				octree.collectPointsNearSegment(segment, radius, actual);
+				actualFirst = octree.findFirstPointAlongSegment(segment, radius);
+			}
+			REQUIRE(expected == getSortedIds(actual));
+			REQUIRE((expectedFirst == nullptr) == (actualFirst == nullptr));
+			if (actualFirst != nullptr) {
+				float distSquared;
+				REQUIRE_EQUAL(expectedFirstParam, getParam(origin, dir, maxParam, actualFirst->getPosition(), distSquared));
+			}
+		}
+	}
+
+	// early termination
+	std::size_t count = 0;
+	REQUIRE(!octree.visitPointsNearRay(Ray3f(Vec3f(-2.0f, 0.0f, 0.0f), Vec3f(1.0f, 0.0f, 0.0f)), 0.2f,
+									   [&count](const IdPoint &) { return ++count < 4; }));
+	REQUIRE_EQUAL(static_cast<std::size_t>(4), count);
+	// degenerated segment
+	std::deque<IdPoint> nearOrigin, expected;
+	octree.collectPointsNearSegment(Segment3f(Vec3f(0.1f, 0.2f, 0.3f), Vec3f(0.1f, 0.2f, 0.3f)), 0.1f, nearOrigin);
+	octree.collectPointsWithinSphere(Sphere_f(Vec3f(0.1f, 0.2f, 0.3f), 0.1f), expected);
+	REQUIRE_EQUAL(expected.size(), nearOrigin.size());
+}
+
+TEST_CASE("PointOctreeTest_frustumQueries", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 20000, -10.0f, 10.0f);
+	const PointOctree<IdPoint> octree(Box(-10.0f, 10.0f, -10.0f, 10.0f, -10.0f, 10.0f), 0.01f, 8, input.begin(),
+									  input.end());
+
+	std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+	for (uint32_t i = 0; i < 20; ++i) {
+		Frustum frustum;
+		frustum.setPerspective(Angle::deg(30.0f + 40.0f * dist(engine)), 1.5f, 0.5f, 5.0f + 10.0f * dist(engine));
+		Vec3f dir = createRandomPosition(engine, -1.0f, 1.0f);
+		dir.normalize();
+		const Vec3f up = dir.cross(Vec3f(dir.y(), dir.z(), -dir.x())).normalize();
+		frustum.setPosition(createRandomPosition(engine, -5.0f, 5.0f), dir, up);
+
+		const auto expected = getSortedIdsIf(input, [&frustum](const IdPoint & p) {
+			return frustum.isBoxInFrustum(Box(p.getPosition(), 0.0f)) != Frustum::intersection_t::OUTSIDE;
+		});
+		std::deque<IdPoint> actual;
+		octree.collectPointsWithinFrustum(frustum, actual);
+		REQUIRE(expected == getSortedIds(actual));
+	}
+
+	Frustum frustum;
+	frustum.setPerspective(Angle::deg(90.0f), 1.0f, 0.1f, 100.0f);
+	std::size_t count = 0;
+	REQUIRE(!octree.visitPointsWithinFrustum(frustum, [&count](const IdPoint &) { return ++count < 7; }));
+	REQUIRE_EQUAL(static_cast<std::size_t>(7), count);
+}
+
+static void checkLodSamples(const Geometry::PointOctree<IdPoint> & cell, const Geometry::PointOctree<IdPoint> & expected) {
+	// the samples of an incrementally built tree have to equal the recalculated ones
+	REQUIRE_EQUAL(expected.getLodSamples().size(), cell.getLodSamples().size());
+	for (std::size_t i = 0; i < cell.getLodSamples().size(); ++i) {
+		REQUIRE_EQUAL(expected.getLodSamples()[i].key, cell.getLodSamples()[i].key);
+		REQUIRE_EQUAL(expected.getLodSamples()[i].point.id, cell.getLodSamples()[i].point.id);
+	}
+	std::deque<IdPoint> subtreePoints;
+	cell.collectPoints(subtreePoints);
+	REQUIRE_EQUAL(std::min<std::size_t>(subtreePoints.size(), cell.getLodSampleCount()), cell.getLodSamples().size());
+	for (const auto & sample : cell.getLodSamples()) {
+		REQUIRE(cell.getBox().contains(sample.point.getPosition()));
+	}
+	REQUIRE_EQUAL(expected.getChildren().size(), cell.getChildren().size());
+	for (std::size_t i = 0; i < cell.getChildren().size(); ++i) {
+		checkLodSamples(cell.getChildren()[i], expected.getChildren()[i]);
+	}
+}
+
+TEST_CASE("PointOctreeTest_lodSamples", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 20000, -1.0f, 1.0f);
+	const Box bounds(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+	PointOctree<IdPoint> incremental(bounds, 0.01f, 16);
+	incremental.enableLodSamples(8);
+	for (const auto & p : input) {
+		REQUIRE(incremental.insert(p));
+	}
+	PointOctree<IdPoint> bulk(bounds, 0.01f, 16, input.begin(), input.end());
+	REQUIRE_EQUAL(static_cast<uint32_t>(0), bulk.getLodSampleCount());
+	REQUIRE(bulk.getLodSamples().empty());
+	bulk.enableLodSamples(8);
+	checkLodSamples(incremental, bulk);
+
+	// a coarse query stops early and returns the samples; a fine one returns all points
+	const Box queryBox(Vec3f(0.1f, 0.2f, -0.1f), 1.2f);
+	std::deque<IdPoint> all, fine, coarse, root;
+	bulk.collectPointsWithinBox(queryBox, all);
+	bulk.collectPointsLOD(queryBox, 0.0f, fine);
+	bulk.collectPointsLOD(queryBox, 0.3f, coarse);
+	bulk.collectPointsLOD(queryBox, 10.0f, root);
+	REQUIRE_EQUAL(all.size(), fine.size());
+	REQUIRE(coarse.size() < all.size());
+	REQUIRE(coarse.size() > root.size());
+	REQUIRE(root.size() <= 8);
+	for (const auto & p : coarse) {
+		REQUIRE(queryBox.contains(p.getPosition()));
+	}
+
+	Frustum frustum;
+	frustum.setPerspective(Angle::deg(60.0f), 1.0f, 0.1f, 10.0f);
+	frustum.setPosition(Vec3f(0.0f, 0.0f, 3.0f), Vec3f(0.0f, 0.0f, -1.0f), Vec3f(0.0f, 1.0f, 0.0f));
+	all.clear();
+	fine.clear();
+	coarse.clear();
+	bulk.collectPointsWithinFrustum(frustum, all);
+	bulk.collectPointsLOD(frustum, 0.0f, fine);
+	bulk.collectPointsLOD(frustum, 0.05f, coarse);
+	REQUIRE(!all.empty());
+	REQUIRE_EQUAL(all.size(), fine.size());
+	REQUIRE(coarse.size() < all.size());
+
+	// removed points vanish from the samples
+	const auto isEven = [](const IdPoint & p) { return p.id % 2 == 0; };
+	bulk.removeIf(isEven);
+	for (std::size_t i = 0; i < input.size(); i += 4) {
+		incremental.remove(input[i]);
+	}
+	std::deque<IdPoint> remaining;
+	bulk.collectPointsLOD(bounds, 10.0f, remaining);
+	for (const auto & p : remaining) {
+		REQUIRE(!isEven(p));
+	}
+	for (const auto & sample : incremental.getLodSamples()) {
+		REQUIRE(sample.point.id % 4 != 0);
+	}
+	bulk.enableLodSamples(0);
+	REQUIRE(bulk.getLodSamples().empty());
+}
+
+TEST_CASE("PointOctreeTest_statistics", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints(engine, 10000, -1.0f, 1.0f);
+	const PointOctree<IdPoint> octree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8, input.begin(),
+									  input.end());
+
+	const auto statistics = octree.getStatistics();
+	std::size_t nodeCount = 0, leafCount = 0, pointCount = 0;
+	for (const auto count : statistics.depthHistogram) {
+		nodeCount += count;
+	}
+	for (std::size_t i = 0; i < statistics.leafOccupancyHistogram.size(); ++i) {
+		leafCount += statistics.leafOccupancyHistogram[i];
+		pointCount += i * statistics.leafOccupancyHistogram[i];
+	}
+	REQUIRE_EQUAL(statistics.nodeCount, nodeCount);
+	REQUIRE_EQUAL(statistics.leafCount, leafCount);
+	REQUIRE_EQUAL(input.size(), statistics.pointCount);
+	REQUIRE_EQUAL(input.size(), pointCount);
+	REQUIRE_EQUAL(static_cast<std::size_t>(1), statistics.depthHistogram.front());
+	REQUIRE(statistics.leafOccupancyHistogram.size() <= 9);
+	REQUIRE(statistics.memoryFootprint >= input.size() * sizeof(IdPoint) + nodeCount * sizeof(PointOctree<IdPoint>));
+
+	// a query containing the whole tree visits every cell and tests no point
+	QueryCounters counters;
+	std::vector<uint32_t> ids;
+	PointOctree<IdPoint>::traversal_stack_t activeCells;
+	octree.visitPointsWithinBox(octree.getBox(), [&ids](const IdPoint & p) {
+		ids.push_back(p.id);
+		return true;
+	}, activeCells, counters);
+	REQUIRE_EQUAL(statistics.nodeCount, counters.nodesVisited);
+	REQUIRE_EQUAL(static_cast<uint64_t>(1), counters.boxesTested);
+	REQUIRE_EQUAL(static_cast<uint64_t>(0), counters.pointsTested);
+	REQUIRE_EQUAL(static_cast<uint64_t>(input.size()), counters.pointsReturned);
+
+	counters.reset();
+	const Box queryBox(Vec3f(0.2f, 0.1f, 0.0f), 0.3f);
+	uint64_t visited = 0;
+	octree.visitPointsWithinBox(queryBox, [&visited](const IdPoint &) {
+		++visited;
+		return true;
+	}, activeCells, counters);
+	REQUIRE_EQUAL(static_cast<uint64_t>(getSortedIdsWithinBox(input, queryBox).size()), counters.pointsReturned);
+	REQUIRE_EQUAL(visited, counters.pointsReturned);
+	REQUIRE(counters.pointsTested >= counters.pointsReturned);
+	REQUIRE(counters.pointsTested < input.size());
+	REQUIRE(counters.nodesVisited < statistics.nodeCount);
+
+	counters.reset();
+	const Sphere_f sphere(Vec3f(-0.3f, 0.4f, 0.1f), 0.25f);
+	octree.visitPointsWithinSphere(sphere, [](const IdPoint &) { return true; }, activeCells, counters);
+	REQUIRE_EQUAL(static_cast<uint64_t>(getSortedIdsWithinRadius(input, sphere.getCenter(), sphere.getRadius()).size()),
+				  counters.pointsReturned);
+	REQUIRE(counters.nodesVisited > 0);
+	REQUIRE(counters.boxesTested > 0);
+
+	// the approximate search does less work than the exact one
+	QueryCounters exactCounters, approximateCounters;
+	std::deque<IdPoint> closest;
+	const Vec3f center(0.1f, -0.2f, 0.3f);
+	octree.getClosestPoints(center, 20, closest, exactCounters);
+	REQUIRE_EQUAL(static_cast<uint64_t>(20), exactCounters.pointsReturned);
+	octree.getApproximateClosestPoints(center, 20, 1.0f, closest, approximateCounters);
+	REQUIRE_EQUAL(static_cast<uint64_t>(20), approximateCounters.pointsReturned);
+	REQUIRE(approximateCounters.pointsTested <= exactCounters.pointsTested);
+	REQUIRE(approximateCounters.nodesVisited <= exactCounters.nodesVisited);
+}
+
+namespace {
+struct CopyCounter {
+	static uint32_t copies;
+
+	CopyCounter() = default;
+	CopyCounter(const CopyCounter &) {
+		++copies;
+	}
+	CopyCounter(CopyCounter &&) = default;
+	CopyCounter & operator=(const CopyCounter &) {
+		++copies;
+		return *this;
+	}
+	CopyCounter & operator=(CopyCounter &&) = default;
+};
+uint32_t CopyCounter::copies = 0;
+
+struct PayloadPoint : public Geometry::MovablePoint<Geometry::Vec3f> {
+	uint32_t id;
+	CopyCounter payload;
+
+	PayloadPoint(const Geometry::Vec3f & pos, uint32_t _id) : Geometry::MovablePoint<Geometry::Vec3f>(pos), id(_id) {
+	}
+
+	//! Distinguish points at the same position, as done by update().
+	bool operator==(const PayloadPoint & other) const {
+		return id == other.id && Geometry::MovablePoint<Geometry::Vec3f>::operator==(other);
+	}
+};
+}
+
+TEST_CASE("PointOctreeTest_moveInsertion", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	static_assert(std::is_move_assignable<MovablePoint<Vec3f>>::value, "MovablePoint has to be assignable");
+	std::default_random_engine engine;
+	std::vector<Vec3f> positions;
+	for (uint32_t i = 0; i < 5000; ++i) {
+		positions.push_back(createRandomPosition(engine, -1.0f, 1.0f));
+	}
+
+	// moved and emplaced points are never copied, not even when leaves are split or cells are merged
+	PointOctree<PayloadPoint> octree(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8);
+	CopyCounter::copies = 0;
+	for (uint32_t i = 0; i < positions.size(); ++i) {
+		if (i % 2 == 0) {
+			PayloadPoint point(positions[i], i);
+			REQUIRE(octree.insert(std::move(point)));
+		} else {
+			REQUIRE(octree.emplace(positions[i], i));
+		}
+	}
+	REQUIRE_FALSE(octree.emplace(Vec3f(2.0f, 0.0f, 0.0f), 0u));
+	REQUIRE(octree.hasChildren());
+	REQUIRE_EQUAL(static_cast<std::size_t>(positions.size()), octree.getStatistics().pointCount);
+	const auto isOdd = [](const PayloadPoint & p) { return p.id % 2 == 1; };
+	REQUIRE_EQUAL(positions.size() / 2, octree.removeIf(isOdd));
+	REQUIRE_EQUAL(static_cast<uint32_t>(0), CopyCounter::copies);
+
+	// copying insertion copies every point exactly once
+	PointOctree<PayloadPoint> copied(Box(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f), 0.01f, 8);
+	for (uint32_t i = 0; i < positions.size(); ++i) {
+		const PayloadPoint point(positions[i], i);
+		REQUIRE(copied.insert(point));
+	}
+	REQUIRE_EQUAL(static_cast<uint32_t>(positions.size()), CopyCounter::copies);
+
+	std::deque<PayloadPoint> found;
+	copied.collectPointsWithinBox(Box(Vec3f(0.0f, 0.0f, 0.0f), 0.5f), found);
+	for (const auto & p : found) {
+		REQUIRE(p.getPosition() == positions[p.id]);
+	}
+}
+
+static void checkUpdatedCell(const Geometry::PointOctree<PayloadPoint> & cell,
+							 const std::vector<Geometry::Vec3f> & positions) {
+	for (const auto & sample : cell.getLodSamples()) {
+		REQUIRE(sample.point.getPosition() == positions[sample.point.id]);
+		REQUIRE(cell.getBox().contains(sample.point.getPosition()));
+	}
+	if (cell.isLeaf()) {
+		REQUIRE((cell.getPoints().size() <= cell.getMaxNumPoints()
+				 || cell.getBox().getExtentMax() < 2.0f * cell.getMinBoxSize()));
+		for (const auto & p : cell.getPoints()) {
+			REQUIRE(cell.getBox().contains(p.getPosition()));
+		}
+	}
+	for (const auto & child : cell.getChildren()) {
+		checkUpdatedCell(child, positions);
+	}
+}
+
+TEST_CASE("PointOctreeTest_update", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	std::default_random_engine engine;
+	std::uniform_real_distribution<float> step(-0.05f, 0.05f);
+	std::vector<Vec3f> positions;
+	const Box bounds(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+	PointOctree<PayloadPoint> octree(bounds, 0.01f, 8);
+	octree.enableLodSamples(4);
+	for (uint32_t i = 0; i < 3000; ++i) {
+		// start in a cluster that spreads out over the frames
+		positions.push_back(createRandomPosition(engine, -0.1f, 0.1f));
+		REQUIRE(octree.emplace(positions.back(), i));
+	}
+
+	for (uint32_t frame = 0; frame < 20; ++frame) {
+		for (uint32_t i = 0; i < positions.size(); ++i) {
+			Vec3f newPosition = positions[i] + Vec3f(step(engine), step(engine), step(engine)) * (frame % 5 + 1.0f);
+			if (!bounds.contains(newPosition)) {
+				REQUIRE_FALSE(octree.update(PayloadPoint(positions[i], i), newPosition));
+				continue;
+			}
+			REQUIRE(octree.update(PayloadPoint(positions[i], i), newPosition));
+			positions[i] = newPosition;
+		}
+		octree.flushUpdates();
+		checkUpdatedCell(octree, positions);
+	}
+	REQUIRE_FALSE(octree.update(PayloadPoint(Vec3f(0.5f, 0.5f, 0.5f), 0), Vec3f(0.0f, 0.0f, 0.0f)));
+
+	std::deque<PayloadPoint> all;
+	octree.collectPoints(all);
+	REQUIRE_EQUAL(positions.size(), all.size());
+	for (const auto & p : all) {
+		REQUIRE(p.getPosition() == positions[p.id]);
+	}
+	const Box queryBox(Vec3f(0.2f, -0.1f, 0.0f), 0.4f);
+	std::deque<PayloadPoint> found;
+	octree.collectPointsWithinBox(queryBox, found);
+	std::size_t expected = 0;
+	for (const auto & position : positions) {
+		if (queryBox.contains(position)) {
+			++expected;
+		}
+	}
+	REQUIRE_EQUAL(expected, found.size());
+	REQUIRE(octree.getStatistics().nodeCount > 1);
+}
+
+TEST_CASE("PointOctreeTest_updateColocated", "[PointOctreeTest]") {
+	using namespace Geometry;
+
+	const Box bounds(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+	const Vec3f sharedPosition(0.25f, 0.25f, 0.25f);
+	PointOctree<PayloadPoint> octree(bounds, 0.01f, 8);
+	octree.enableLodSamples(4);
+	REQUIRE(octree.emplace(sharedPosition, 0u));
+	REQUIRE(octree.emplace(sharedPosition, 1u));
+	REQUIRE(octree.emplace(Vec3f(-0.5f, 0.5f, -0.5f), 2u));
+
+	// only the second point is moved; the first one keeps its sample
+	REQUIRE(octree.update(PayloadPoint(sharedPosition, 1), Vec3f(-0.75f, -0.75f, 0.75f)));
+	octree.flushUpdates();
+	std::vector<uint32_t> sampleIds;
+	for (const auto & sample : octree.getLodSamples()) {
+		sampleIds.push_back(sample.point.id);
+		if (sample.point.id == 1) {
+			REQUIRE(sample.point.getPosition() == Vec3f(-0.75f, -0.75f, 0.75f));
+		} else if (sample.point.id == 0) {
+			REQUIRE(sample.point.getPosition() == sharedPosition);
+		}
+	}
+	std::sort(sampleIds.begin(), sampleIds.end());
+	REQUIRE(sampleIds == std::vector<uint32_t>({0, 1, 2}));
+}
@@ -0,0 +1,127 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#ifndef GEOMETRY_TESTS_POINTTESTHELPER_H
+#define GEOMETRY_TESTS_POINTTESTHELPER_H
+
+#include "Point.h"
+#include "Vec3.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Fixture shared by the tests of the point data structures: points with identifiers, random input, linear searches
+ * over the input as reference for the query results, and corruption of stored trees.
+ */
+namespace PointTestHelper {
+
+//! Point with an identifier that makes the results of different queries comparable.
+template <typename Vector_t>
+struct BasicIdPoint : public Geometry::Point<Vector_t> {
+	uint32_t id;
+
+	BasicIdPoint(const Vector_t & pos, uint32_t _id) : Geometry::Point<Vector_t>(pos), id(_id) {
+	}
+};
+typedef BasicIdPoint<Geometry::Vec3f> IdPoint;
+
+//! Return the identifiers of the points in ascending order.
+template <typename Container_t>
+std::vector<uint32_t> getSortedIds(const Container_t & points) {
+	std::vector<uint32_t> ids;
+	for (const auto & p : points) {
+		ids.push_back(p.id);
+	}
+	std::sort(ids.begin(), ids.end());
+	return ids;
+}
+
+//! Return a position whose coordinates are drawn uniformly from [min, max), in the order x, y, z.
+inline Geometry::Vec3f createRandomPosition(std::default_random_engine & engine, float min, float max) {
+	std::uniform_real_distribution<float> dist(min, max);
+	const float x = dist(engine);
+	const float y = dist(engine);
+	const float z = dist(engine);
+	return Geometry::Vec3f(x, y, z);
+}
+
+//! Return @p count points at random positions (see createRandomPosition()) with the identifiers zero to count - 1.
+inline std::vector<IdPoint> createRandomPoints(std::default_random_engine & engine, uint32_t count, float min,
+											   float max) {
+	std::vector<IdPoint> points;
+	points.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		points.emplace_back(createRandomPosition(engine, min, max), i);
+	}
+	return points;
+}
+
+/**
+ * @name Brute-force reference
+ * Linear searches over all points of the input.
+ */
+//@{
+//! Return the sorted identifiers of the points for which the predicate returns @c true.
+template <typename Point_t, typename Predicate_t>
+std::vector<uint32_t> getSortedIdsIf(const std::vector<Point_t> & input, Predicate_t predicate) {
+	std::vector<uint32_t> ids;
+	for (const auto & p : input) {
+		if (predicate(p)) {
+			ids.push_back(p.id);
+		}
+	}
+	std::sort(ids.begin(), ids.end());
+	return ids;
+}
+
+//! Return the sorted identifiers of the points inside of the box.
+template <typename Point_t, typename Box_t>
+std::vector<uint32_t> getSortedIdsWithinBox(const std::vector<Point_t> & input, const Box_t & box) {
+	return getSortedIdsIf(input, [&box](const Point_t & p) { return box.contains(p.getPosition()); });
+}
+
+//! Return the sorted identifiers of the points with a distance of at most @p radius to @p center.
+template <typename Point_t, typename Vector_t>
+std::vector<uint32_t> getSortedIdsWithinRadius(const std::vector<Point_t> & input, const Vector_t & center,
+											   typename Vector_t::value_t radius) {
+	return getSortedIdsIf(input, [&](const Point_t & p) {
+		return center.distanceSquared(p.getPosition()) <= radius * radius;
+	});
+}
+
+//! Return the squared distances of the @p count points closest to @p pos in ascending order.
+template <typename Point_t, typename Vector_t>
+std::vector<typename Vector_t::value_t> getClosestDistancesSquared(const std::vector<Point_t> & input,
+																   const Vector_t & pos, std::size_t count) {
+	std::vector<typename Vector_t::value_t> distances;
+	for (const auto & p : input) {
+		distances.push_back(pos.distanceSquared(p.getPosition()));
+	}
+	std::sort(distances.begin(), distances.end());
+	distances.resize(std::min(count, distances.size()));
+	return distances;
+}
+//@}
+
+//! Overwrite @p size bytes at @p offset of the file with @p data.
+inline void patchFile(const std::string & fileName, std::size_t offset, const void * data, std::size_t size) {
+	std::fstream file(fileName.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+	file.seekp(static_cast<std::streamoff>(offset));
+	file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+}
+}
+
+#endif /* GEOMETRY_TESTS_POINTTESTHELPER_H */
@@ -0,0 +1,198 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2007-2012 Benjamin Eikel <benjamin@eikel.org>
+	Copyright (C) 2007-2012 Claudius Jähn <claudius@uni-paderborn.de>
+	Copyright (C) 2007-2012 Ralf Petring <ralf@petring.net>
+	Copyright (C) 2015-2019 Sascha Brandt <sascha@brandt.graphics>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include "PointTestHelper.h"
+#include "PointTree.h"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+#include <catch2/catch.hpp>
+#define REQUIRE_EQUAL(a,b) REQUIRE((a) == (b))
+
+using namespace PointTestHelper;
+
+namespace {
+typedef BasicIdPoint<Geometry::Vec2d> IdPoint2d;
+typedef BasicIdPoint<Geometry::Vec3d> IdPoint3d;
+
+//! Return a position whose coordinates are drawn uniformly from [-1, 1), in the order x, y.
+Geometry::Vec2d createRandomPosition2d(std::default_random_engine & engine) {
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	const double x = dist(engine);
+	const double y = dist(engine);
+	return Geometry::Vec2d(x, y);
+}
+
+//! Return @p count points at random positions (see createRandomPosition2d()) with the identifiers zero to count - 1.
+std::vector<IdPoint2d> createRandomPoints2d(std::default_random_engine & engine, uint32_t count) {
+	std::vector<IdPoint2d> points;
+	for (uint32_t i = 0; i < count; ++i) {
+		points.emplace_back(createRandomPosition2d(engine), i);
+	}
+	return points;
+}
+
+//! Compare the queries of the tree with a linear search over all points.
+template <typename Tree_t, typename Point_t, typename Generator_t>
+void checkQueries(const Tree_t & tree, const std::vector<Point_t> & input, Generator_t generatePosition,
+				  typename Tree_t::box_t (*createBox)(const typename Tree_t::vec_t &, double)) {
+	using vec_t = typename Tree_t::vec_t;
+	std::default_random_engine engine;
+	std::uniform_real_distribution<double> sizeDist(0.0, 0.3);
+	for (uint32_t q = 0; q < 50; ++q) {
+		const vec_t center = generatePosition();
+		const double size = sizeDist(engine);
+		{
+			const auto queryBox = createBox(center, size);
+			std::deque<Point_t> found;
+			tree.collectPointsWithinBox(queryBox, found);
+			REQUIRE(getSortedIdsWithinBox(input, queryBox) == getSortedIds(found));
+		}
+		{
+			std::deque<Point_t> found;
+			tree.collectPointsWithinRadius(center, size, found);
+			REQUIRE(getSortedIdsWithinRadius(input, center, size) == getSortedIds(found));
+		}
+		{
+			const auto expected = getClosestDistancesSquared(input, center, 1 + q % 20);
+			std::deque<Point_t> closest;
+			tree.getClosestPoints(center, 1 + q % 20, closest);
+			REQUIRE_EQUAL(expected.size(), closest.size());
+			for (std::size_t i = 0; i < closest.size(); ++i) {
+				REQUIRE_EQUAL(expected[i], center.distanceSquared(closest[i].getPosition()));
+			}
+		}
+	}
+}
+
+Geometry::Rect_d createRect(const Geometry::Vec2d & center, double size) {
+	return Geometry::Rect_d(center.x() - size, center.y() - size, 2.0 * size, 2.0 * size);
+}
+Geometry::Box_d createBox(const Geometry::Vec3d & center, double size) {
+	return Geometry::Box_d(center, 2.0 * size);
+}
+}
+
+TEST_CASE("PointTreeTest_quadtree", "[PointTreeTest]") {
+	using namespace Geometry;
+	using point_t = IdPoint2d;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints2d(engine, 5000);
+	PointQuadtree<point_t, double> tree(Rect_d(-1.0, -1.0, 2.0, 2.0), 0.001, 8, input.begin(), input.end());
+	REQUIRE(tree.hasChildren());
+	REQUIRE(tree.getChildren().size() == 4);
+	REQUIRE_FALSE(tree.insert(point_t(Vec2d(1.5, 0.0), 5000)));
+	checkQueries(tree, input, [&]() { return createRandomPosition2d(engine); }, &createRect);
+
+	// remove every second point
+	std::vector<point_t> remaining;
+	for (const auto & p : input) {
+		if (p.id % 2 == 0) {
+			REQUIRE(tree.remove(p));
+		} else {
+			remaining.push_back(p);
+		}
+	}
+	REQUIRE_FALSE(tree.remove(input.front()));
+	std::deque<point_t> all;
+	tree.collectPoints(all);
+	REQUIRE(getSortedIds(all) == getSortedIds(remaining));
+	checkQueries(tree, remaining, [&]() { return createRandomPosition2d(engine); }, &createRect);
+
+	// an elongated rectangle is only split along its long axis
+	PointQuadtree<point_t> stripe(Rect(0.0f, 0.0f, 4.0f, 1.0f), 0.01f, 1);
+	REQUIRE(stripe.emplace(Vec2(0.5f, 0.5f), 0u));
+	REQUIRE(stripe.emplace(Vec2(3.5f, 0.5f), 1u));
+	REQUIRE_EQUAL(static_cast<std::size_t>(2), stripe.getChildren().size());
+	REQUIRE(stripe.getChildren()[0].getBox() == Rect(0.0f, 0.0f, 2.0f, 1.0f));
+}
+
+TEST_CASE("PointTreeTest_doublePrecision", "[PointTreeTest]") {
+	using namespace Geometry;
+	using point_t = IdPoint3d;
+
+	// geo-referenced coordinates that cannot be distinguished in single precision
+	const Vec3d origin(6378137.0, 512345.0, 1200.0);
+	std::default_random_engine engine;
+	std::uniform_real_distribution<double> dist(-0.2, 0.2);
+	const auto generatePosition = [&]() {
+		const double x = dist(engine);
+		const double y = dist(engine);
+		const double z = dist(engine);
+		return origin + Vec3d(x, y, z);
+	};
+	std::vector<point_t> input;
+	std::vector<float> singlePrecision;
+	for (uint32_t i = 0; i < 5000; ++i) {
+		input.emplace_back(generatePosition(), i);
+		singlePrecision.push_back(static_cast<float>(input.back().getPosition().x()));
+	}
+	std::sort(singlePrecision.begin(), singlePrecision.end());
+	REQUIRE(std::unique(singlePrecision.begin(), singlePrecision.end()) - singlePrecision.begin() <= 3);
+
+	PointTree<point_t, double, 3> tree(Box_d(origin, 0.4), 0.00001, 8);
+	for (const auto & p : input) {
+		REQUIRE(tree.insert(p));
+	}
+	REQUIRE_EQUAL(static_cast<std::size_t>(8), tree.getChildren().size());
+	checkQueries(tree, input, generatePosition, &createBox);
+
+	const auto * leaf = tree.findLeafCell(input[42].getPosition());
+	REQUIRE(leaf != nullptr);
+	REQUIRE(leaf->isLeaf());
+	REQUIRE(leaf->getBox().contains(input[42].getPosition()));
+	REQUIRE(tree.findLeafCell(Vec3d(0.0, 0.0, 0.0)) == nullptr);
+}
+
+TEST_CASE("PointTreeTest_sharedInterface", "[PointTreeTest]") {
+	using namespace Geometry;
+	using point_t = IdPoint2d;
+
+	std::default_random_engine engine;
+	const auto input = createRandomPoints2d(engine, 5000);
+	const Rect_d bounds(-1.0, -1.0, 2.0, 2.0);
+	PointQuadtree<point_t, double> incremental(bounds, 0.001, 8);
+	for (const auto & p : input) {
+		REQUIRE(incremental.insert(p));
+	}
+	PointQuadtree<point_t, double> parallel(bounds, 0.001, 8, input.begin(), input.end(), 4, 100);
+	const auto statistics = parallel.getStatistics();
+	REQUIRE_EQUAL(input.size(), statistics.pointCount);
+	REQUIRE_EQUAL(incremental.getStatistics().nodeCount, statistics.nodeCount);
+	REQUIRE_EQUAL(static_cast<std::size_t>(1), statistics.depthHistogram.front());
+
+	// the approximate search without error bound equals the exact one
+	const Vec2d center(0.1, -0.3);
+	std::deque<point_t> exact, approximate;
+	parallel.getClosestPoints(center, 10, exact);
+	parallel.getApproximateClosestPoints(center, 10, 0.0, approximate);
+	REQUIRE(getSortedIds(exact) == getSortedIds(approximate));
+
+	// removing by predicate merges the cells like remove()
+	REQUIRE_EQUAL(static_cast<std::size_t>(2500),
+				  parallel.removeIf([](const point_t & p) { return p.id % 2 == 0; }));
+	std::vector<point_t> remaining;
+	for (const auto & p : input) {
+		if (p.id % 2 == 0) {
+			REQUIRE(incremental.remove(p));
+		} else {
+			remaining.push_back(p);
+		}
+	}
+	std::deque<point_t> all;
+	parallel.collectPoints(all);
+	REQUIRE(getSortedIds(all) == getSortedIds(remaining));
+	REQUIRE_EQUAL(incremental.getStatistics().nodeCount, parallel.getStatistics().nodeCount);
+	checkQueries(parallel, remaining, [&]() { return createRandomPosition2d(engine); }, &createRect);
+}
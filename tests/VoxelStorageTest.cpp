@@ -0,0 +1,435 @@
+/*
+	This file is part of the Geometry library.
+	Copyright (C) 2014 Claudius Jähn <claudius@uni-paderborn.de>
+
+	This library is subject to the terms of the Mozilla Public License, v. 2.0.
+	You should have received a copy of the MPL along with this library; see the
+	file LICENSE. If not, you can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include "VoxelStorage.h"
+#include "Line.h"
+#include "Vec3.h"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <catch2/catch.hpp>
+#define REQUIRE_EQUAL(a,b) REQUIRE((a) == (b))
+
+namespace {
+typedef Geometry::VoxelStorage<uint32_t> Storage_t;
+typedef Storage_t::Vec3_t Vec3_t;
+typedef Storage_t::Box_t Box_t;
+
+void checkEqual(const Storage_t & expected, const Storage_t & actual, const Box_t & box) {
+	for (int32_t z = box.getMinZ(); z <= box.getMaxZ(); ++z) {
+		for (int32_t y = box.getMinY(); y <= box.getMaxY(); ++y) {
+			for (int32_t x = box.getMinX(); x <= box.getMaxX(); ++x) {
+				REQUIRE_EQUAL(expected.get(Vec3_t(x, y, z)), actual.get(Vec3_t(x, y, z)));
+			}
+		}
+	}
+}
+
+//! Reference for the ray queries: step voxel by voxel along the segment and call get() for every voxel.
+template <typename Predicate_t>
+bool findFirstVoxelByStepping(const Storage_t & storage, const Geometry::Segment3f & segment, Predicate_t predicate,
+							  Vec3_t & hitPosition) {
+	const Geometry::Vec3f & origin = segment.getOrigin();
+	const Geometry::Vec3f & direction = segment.getDirection();
+	Vec3_t pos(static_cast<int32_t>(std::floor(origin.x())), static_cast<int32_t>(std::floor(origin.y())),
+			   static_cast<int32_t>(std::floor(origin.z())));
+	int32_t step[3];
+	float tNext[3];
+	float tDelta[3];
+	for (uint8_t a = 0; a < 3; ++a) {
+		step[a] = direction[a] > 0 ? 1 : (direction[a] < 0 ? -1 : 0);
+		tDelta[a] = step[a] != 0 ? std::abs(1.0f / direction[a]) : std::numeric_limits<float>::infinity();
+		tNext[a] = step[a] > 0 ? (pos[a] + 1 - origin[a]) / direction[a]
+							   : (step[a] < 0 ? (pos[a] - origin[a]) / direction[a] : tDelta[a]);
+	}
+	while (true) {
+		if (predicate(storage.get(pos))) {
+			hitPosition = pos;
+			return true;
+		}
+		const uint8_t a = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+		if (tNext[a] >= segment.length())
+			return false;
+		pos[a] += step[a];
+		tNext[a] += tDelta[a];
+	}
+}
+}
+
+TEST_CASE("VoxelStorageTest_batchSet", "[VoxelStorageTest]") {
+	std::default_random_engine engine(7);
+	std::uniform_int_distribution<int32_t> coordinateDist(3, 43);
+	std::uniform_int_distribution<uint32_t> valueDist(0, 3);
+	const Box_t testBox(Vec3_t(0, 0, 0), Vec3_t(48, 48, 48));
+
+	std::vector<std::pair<Vec3_t, uint32_t>> voxels;
+	for (uint32_t i = 0; i < 5000; ++i) {
+		voxels.emplace_back(Vec3_t(coordinateDist(engine), coordinateDist(engine), coordinateDist(engine)),
+							valueDist(engine));
+	}
+
+	Storage_t single(0);
+	for (const auto & voxel : voxels)
+		single.set(voxel.first, voxel.second);
+
+	Storage_t batched(0);
+	batched.set(voxels);
+	checkEqual(single, batched, testBox);
+	REQUIRE_EQUAL(single.getBlockBounds(), batched.getBlockBounds());
+
+	// dense sub-volume
+	const Box_t area(Vec3_t(5, 3, 22), Vec3_t(16, 19, 33));
+	std::vector<uint32_t> values;
+	for (int32_t z = area.getMinZ(); z <= area.getMaxZ(); ++z) {
+		for (int32_t y = area.getMinY(); y <= area.getMaxY(); ++y) {
+			for (int32_t x = area.getMinX(); x <= area.getMaxX(); ++x) {
+				const uint32_t value = static_cast<uint32_t>(x * x + y + z) % 5;
+				values.push_back(value);
+				single.set(Vec3_t(x, y, z), value);
+			}
+		}
+	}
+	batched.set(area, values);
+	checkEqual(single, batched, testBox);
+
+	REQUIRE_THROWS_AS(batched.set(area, std::vector<uint32_t>(values.size() - 1)), std::invalid_argument);
+
+	// writing a uniform, block-aligned volume must consolidate the touched blocks
+	Storage_t uniform(0);
+	const Box_t alignedArea(Vec3_t(0, 0, 0), Vec3_t(15, 15, 15));
+	uniform.set(alignedArea, std::vector<uint32_t>(16 * 16 * 16, 3));
+	const auto data = uniform.serialize(alignedArea);
+	REQUIRE(data.second.empty());
+	REQUIRE_EQUAL(uniform.get(Vec3_t(7, 7, 7)), 3u);
+	REQUIRE_EQUAL(uniform.get(Vec3_t(16, 7, 7)), 0u);
+}
+
+TEST_CASE("VoxelStorageTest_accessor", "[VoxelStorageTest]") {
+	std::default_random_engine engine(11);
+	std::uniform_int_distribution<int32_t> coordinateDist(1, 30);
+	std::uniform_int_distribution<uint32_t> valueDist(0, 2);
+	const Box_t testBox(Vec3_t(0, 0, 0), Vec3_t(32, 32, 32));
+
+	Storage_t reference(0);
+	Storage_t storage(0);
+	for (uint32_t i = 0; i < 2000; ++i) {
+		const Vec3_t pos(coordinateDist(engine), coordinateDist(engine), coordinateDist(engine));
+		const uint32_t value = valueDist(engine);
+		reference.set(pos, value);
+		storage.set(pos, value);
+	}
+
+	Storage_t::Accessor accessor(storage);
+	for (uint32_t i = 0; i < 200; ++i) {
+		// random walk of 26-neighbor stencils, reading and writing
+		const Vec3_t center(coordinateDist(engine), coordinateDist(engine), coordinateDist(engine));
+		for (int32_t dz = -1; dz <= 1; ++dz) {
+			for (int32_t dy = -1; dy <= 1; ++dy) {
+				for (int32_t dx = -1; dx <= 1; ++dx) {
+					const Vec3_t pos = center + Vec3_t(dx, dy, dz);
+					REQUIRE_EQUAL(accessor.get(pos), reference.get(pos));
+				}
+			}
+		}
+		const uint32_t value = valueDist(engine);
+		accessor.set(center, value);
+		reference.set(center, value);
+		REQUIRE_EQUAL(accessor.get(center), value);
+
+		// modifications of the storage itself invalidate the accessor's cache
+		if (i % 50 == 25) {
+			const Box_t fillBox(center, center + Vec3_t(5, 3, 4));
+			storage.fill(fillBox, value);
+			reference.fill(fillBox, value);
+		} else if (i % 50 == 49) {
+			storage.consolidate();
+		}
+	}
+	REQUIRE_EQUAL(accessor.get(Vec3_t(1000, 1000, 1000)), 0u);
+	storage.consolidate();
+	checkEqual(reference, storage, testBox);
+
+	// writes through the accessor are consolidated afterwards
+	Storage_t uniform(0);
+	Storage_t::Accessor uniformAccessor(uniform);
+	for (int32_t z = 0; z < 8; ++z) {
+		for (int32_t y = 0; y < 8; ++y) {
+			for (int32_t x = 0; x < 8; ++x)
+				uniformAccessor.set(Vec3_t(x, y, z), 5);
+		}
+	}
+	uniform.consolidate();
+	REQUIRE(uniform.serialize(Box_t(Vec3_t(0, 0, 0), Vec3_t(7, 7, 7))).second.empty());
+	REQUIRE_EQUAL(uniformAccessor.get(Vec3_t(3, 4, 5)), 5u);
+	uniform.clear();
+	REQUIRE_EQUAL(uniformAccessor.get(Vec3_t(3, 4, 5)), 0u);
+}
+
+TEST_CASE("VoxelStorageTest_pooledAllocation", "[VoxelStorageTest]") {
+	std::default_random_engine engine(13);
+	std::uniform_int_distribution<int32_t> coordinateDist(0, 63);
+	const Box_t testBox(Vec3_t(0, 0, 0), Vec3_t(63, 63, 63));
+	std::vector<std::pair<Vec3_t, uint32_t>> voxels;
+	for (uint32_t i = 0; i < 3000; ++i)
+		voxels.emplace_back(Vec3_t(coordinateDist(engine), coordinateDist(engine), coordinateDist(engine)), 1 + i % 3);
+
+	Storage_t storage(0);
+	REQUIRE_EQUAL(storage.getMemoryUsage(), 0u);
+	storage.set(voxels);
+	const size_t memoryUsage = storage.getMemoryUsage();
+	REQUIRE(memoryUsage > 0);
+
+	// released areas and blocks are reused
+	for (uint32_t round = 0; round < 3; ++round) {
+		storage.fill(testBox, 0);
+		REQUIRE_EQUAL(storage.get(voxels.front().first), 0u);
+		storage.set(voxels);
+		REQUIRE_EQUAL(storage.getMemoryUsage(), memoryUsage);
+	}
+	Storage_t reference(0);
+	reference.set(voxels);
+	checkEqual(reference, storage, testBox);
+
+	Storage_t moved(std::move(storage));
+	checkEqual(reference, moved, testBox);
+	REQUIRE_EQUAL(moved.getMemoryUsage(), memoryUsage);
+	REQUIRE_EQUAL(storage.getMemoryUsage(), 0u);
+	REQUIRE_EQUAL(storage.get(voxels.front().first), 0u);
+
+	moved.clear();
+	REQUIRE_EQUAL(moved.getMemoryUsage(), 0u);
+	REQUIRE_EQUAL(moved.get(voxels.front().first), 0u);
+
+	// voxels with non-trivial destructors are destroyed properly
+	const auto value = std::make_shared<int>(5);
+	{
+		Geometry::VoxelStorage<std::shared_ptr<int>> sharedStorage(nullptr);
+		for (int32_t x = 0; x < 10; ++x)
+			sharedStorage.set(Vec3_t(x, 2 * x, 0), value);
+		REQUIRE(value.use_count() > 1);
+		sharedStorage.fill(Box_t(Vec3_t(0, 0, 0), Vec3_t(31, 31, 31)), nullptr);
+		REQUIRE_EQUAL(value.use_count(), 1);
+		sharedStorage.set(Vec3_t(3, 3, 3), value);
+		REQUIRE(value.use_count() > 1);
+	}
+	REQUIRE_EQUAL(value.use_count(), 1);
+}
+
+TEST_CASE("VoxelStorageTest_parallelFill", "[VoxelStorageTest]") {
+	std::default_random_engine engine(17);
+	std::uniform_int_distribution<int32_t> coordinateDist(0, 200);
+	std::uniform_int_distribution<int32_t> sizeDist(0, 90);
+	std::uniform_int_distribution<uint32_t> valueDist(0, 3);
+	const Box_t wholeBox(Vec3_t(0, 0, 0), Vec3_t(300, 300, 300));
+
+	Storage_t sequential(0);
+	Storage_t parallel(0);
+	std::vector<std::pair<Vec3_t, uint32_t>> voxels;
+	for (uint32_t i = 0; i < 2000; ++i)
+		voxels.emplace_back(Vec3_t(coordinateDist(engine), coordinateDist(engine), coordinateDist(engine)), 1);
+	sequential.set(voxels);
+	parallel.set(voxels);
+
+	for (uint32_t i = 0; i < 20; ++i) {
+		const Vec3_t min(coordinateDist(engine), coordinateDist(engine), coordinateDist(engine));
+		const Box_t fillBox(min, min + Vec3_t(sizeDist(engine), sizeDist(engine), sizeDist(engine)));
+		const uint32_t value = valueDist(engine);
+		sequential.fill(fillBox, value);
+		parallel.fill(fillBox, value, 4, 8);
+		REQUIRE(sequential.serialize(wholeBox) == parallel.serialize(wholeBox));
+	}
+
+	// consolidation of changes made without consolidating
+	for (uint32_t i = 0; i < 3000; ++i) {
+		const Vec3_t pos(coordinateDist(engine), coordinateDist(engine), coordinateDist(engine));
+		sequential._set(pos, 2);
+		parallel._set(pos, 2);
+	}
+	sequential.consolidate();
+	parallel.consolidate(3, 16);
+	REQUIRE(sequential.serialize(wholeBox) == parallel.serialize(wholeBox));
+
+	// number of hardware threads
+	for (uint32_t i = 0; i < 1000; ++i) {
+		const Vec3_t pos(coordinateDist(engine), coordinateDist(engine), coordinateDist(engine));
+		sequential._set(pos, 3);
+		parallel._set(pos, 3);
+	}
+	sequential.consolidate();
+	parallel.consolidate(0);
+	REQUIRE(sequential.serialize(wholeBox) == parallel.serialize(wholeBox));
+
+	// deserialization
+	const auto data = sequential.serialize(wholeBox);
+	Storage_t sequentialCopy(0);
+	Storage_t parallelCopy(0);
+	sequentialCopy.deserialize(data);
+	parallelCopy.deserialize(data, 4, 4);
+	REQUIRE(sequentialCopy.serialize(wholeBox) == parallelCopy.serialize(wholeBox));
+}
+
+TEST_CASE("VoxelStorageTest_deserializeAdjacentAreas", "[VoxelStorageTest]") {
+	// uniform areas of different values that touch each other on all axes
+	const Box_t wholeBox(Vec3_t(0, 0, 0), Vec3_t(127, 127, 127));
+	Storage_t storage(0);
+	uint32_t value = 1;
+	for (int32_t z = 0; z < 128; z += 32) {
+		for (int32_t y = 0; y < 128; y += 32) {
+			for (int32_t x = 0; x < 128; x += 32)
+				storage.fill(Box_t(Vec3_t(x, y, z), Vec3_t(x + 31, y + 31, z + 31)), value++);
+		}
+	}
+	storage.fill(Box_t(Vec3_t(32, 32, 32), Vec3_t(47, 39, 32)), 100);
+	const auto data = storage.serialize(wholeBox);
+	REQUIRE(data.first.size() >= 64);
+
+	Storage_t sequentialCopy(0);
+	sequentialCopy.deserialize(data);
+	checkEqual(storage, sequentialCopy, Box_t(Vec3_t(-1, -1, -1), Vec3_t(128, 128, 128)));
+	REQUIRE(sequentialCopy.serialize(wholeBox) == data);
+	REQUIRE(sequentialCopy.getBlockBounds() == storage.getBlockBounds());
+	for (const uint32_t numThreads : {1u, 4u}) {
+		Storage_t parallelCopy(0);
+		parallelCopy.deserialize(data, numThreads, 8);
+		checkEqual(storage, parallelCopy, Box_t(Vec3_t(-1, -1, -1), Vec3_t(128, 128, 128)));
+		REQUIRE(parallelCopy.serialize(wholeBox) == data);
+	}
+}
+
+namespace {
+//! Voxel value whose assignment throws while @c failing is set.
+struct FailingVoxel {
+	static std::atomic<bool> failing;
+	uint32_t value;
+
+	FailingVoxel(uint32_t _value = 0) : value(_value) {
+	}
+	FailingVoxel(const FailingVoxel &) = default;
+	FailingVoxel & operator=(const FailingVoxel & other) {
+		if (failing)
+			throw std::runtime_error("FailingVoxel: assignment failed");
+		value = other.value;
+		return *this;
+	}
+	bool operator==(const FailingVoxel & other) const {
+		return value == other.value;
+	}
+	bool operator!=(const FailingVoxel & other) const {
+		return value != other.value;
+	}
+};
+std::atomic<bool> FailingVoxel::failing(false);
+}
+
+TEST_CASE("VoxelStorageTest_parallelException", "[VoxelStorageTest]") {
+	typedef Geometry::VoxelStorage<FailingVoxel> FailingStorage_t;
+	const Box_t wholeBox(Vec3_t(0, 0, 0), Vec3_t(255, 255, 255));
+
+	FailingStorage_t storage(FailingVoxel(0));
+	for (int32_t i = 0; i < 256; i += 3)
+		storage.set(Vec3_t(i, 255 - i, i / 2), FailingVoxel(1));
+	const auto data = storage.serialize(wholeBox);
+
+	// the exceptions of the worker threads are passed to the calling thread instead of terminating the process
+	FailingVoxel::failing = true;
+	REQUIRE_THROWS_AS(storage.fill(Box_t(Vec3_t(0, 0, 0), Vec3_t(200, 100, 150)), FailingVoxel(2), 4, 8),
+					  std::runtime_error);
+	FailingStorage_t copy(FailingVoxel(0));
+	REQUIRE_THROWS_AS(copy.deserialize(data, 4, 4), std::runtime_error);
+	FailingVoxel::failing = false;
+	for (int32_t i = 0; i < 2000; ++i)
+		storage._set(Vec3_t(i % 256, (7 * i) % 256, (13 * i) % 256), FailingVoxel(3));
+	FailingVoxel::failing = true;
+	REQUIRE_THROWS_AS(storage.consolidate(4, 8), std::runtime_error);
+	FailingVoxel::failing = false;
+
+	// the storages stay usable
+	storage.fill(wholeBox, FailingVoxel(4), 4, 8);
+	REQUIRE(storage.get(Vec3_t(17, 100, 230)) == FailingVoxel(4));
+	REQUIRE(storage.get(Vec3_t(256, 0, 0)) == FailingVoxel(0));
+	copy.clear();
+	copy.deserialize(data, 4, 4);
+	REQUIRE(copy.serialize(wholeBox) == data);
+}
+
+TEST_CASE("VoxelStorageTest_findFirstVoxelAlongRay", "[VoxelStorageTest]") {
+	Storage_t storage(0);
+	Vec3_t hitPosition;
+	float hitParam = -1.0f;
+	REQUIRE(storage.findFirstVoxelAlongRay(Geometry::Ray3f(Geometry::Vec3f(0.5f, 0.5f, 0.5f),
+														   Geometry::Vec3f(1.0f, 0.0f, 0.0f))) == nullptr);
+
+	storage.fill(Box_t(Vec3_t(1000, 0, 0), Vec3_t(1063, 63, 63)), 5);
+	storage.set(Vec3_t(500, 2, 3), 7);
+	const Geometry::Ray3f ray(Geometry::Vec3f(-200.5f, 2.5f, 3.5f), Geometry::Vec3f(1.0f, 0.0f, 0.0f));
+	const uint32_t * voxel = storage.findFirstVoxelAlongRay(ray, &hitPosition, &hitParam);
+	REQUIRE(voxel != nullptr);
+	REQUIRE_EQUAL(*voxel, 7u);
+	REQUIRE_EQUAL(hitPosition, Vec3_t(500, 2, 3));
+	REQUIRE(std::abs(hitParam - 700.5f) < 1.0e-3f);
+
+	// predicate skipping the single voxel; the uniform area is hit at its boundary
+	voxel = storage.findFirstVoxelAlongRay(ray, [](uint32_t value) { return value == 5; }, &hitPosition, &hitParam);
+	REQUIRE(voxel != nullptr);
+	REQUIRE_EQUAL(*voxel, 5u);
+	REQUIRE_EQUAL(hitPosition, Vec3_t(1000, 2, 3));
+	REQUIRE(std::abs(hitParam - 1200.5f) < 1.0e-3f);
+
+	// predicate matching null voxels outside of the root
+	voxel = storage.findFirstVoxelAlongRay(ray, [](uint32_t value) { return value == 0; }, &hitPosition);
+	REQUIRE(voxel != nullptr);
+	REQUIRE_EQUAL(hitPosition, Vec3_t(-201, 2, 3));
+
+	// segment ending in front of the voxel
+	REQUIRE(storage.findFirstVoxelAlongSegment(Geometry::Segment3f(Geometry::Vec3f(-200.5f, 2.5f, 3.5f),
+																   Geometry::Vec3f(499.5f, 2.5f, 3.5f))) == nullptr);
+
+	// compare random segments with stepping voxel by voxel
+	std::default_random_engine engine(23);
+	std::uniform_int_distribution<int32_t> coordinateDist(0, 80);
+	std::uniform_int_distribution<int32_t> sizeDist(0, 20);
+	std::uniform_int_distribution<uint32_t> valueDist(0, 3);
+	std::uniform_real_distribution<float> pointDist(-20.0f, 100.0f);
+	storage.clear();
+	for (uint32_t i = 0; i < 30; ++i) {
+		const Vec3_t min(coordinateDist(engine), coordinateDist(engine), coordinateDist(engine));
+		storage.fill(Box_t(min, min + Vec3_t(sizeDist(engine), sizeDist(engine), sizeDist(engine))),
+					 valueDist(engine));
+	}
+	for (uint32_t i = 0; i < 300; ++i)
+		storage.set(Vec3_t(coordinateDist(engine), coordinateDist(engine), coordinateDist(engine)), valueDist(engine));
+
+	auto isTwo = [](uint32_t value) { return value == 2; };
+	for (uint32_t i = 0; i < 1000; ++i) {
+		const Geometry::Segment3f segment(Geometry::Vec3f(pointDist(engine), pointDist(engine), pointDist(engine)),
+										  Geometry::Vec3f(pointDist(engine), pointDist(engine), pointDist(engine)));
+		Vec3_t expectedPosition;
+		const bool expectedHit =
+				findFirstVoxelByStepping(storage, segment, [](uint32_t value) { return value != 0; }, expectedPosition);
+		voxel = storage.findFirstVoxelAlongSegment(segment, &hitPosition);
+		REQUIRE_EQUAL(voxel != nullptr, expectedHit);
+		if (expectedHit) {
+			REQUIRE_EQUAL(hitPosition, expectedPosition);
+			REQUIRE_EQUAL(*voxel, storage.get(hitPosition));
+		}
+
+		const bool expectedTwo = findFirstVoxelByStepping(storage, segment, isTwo, expectedPosition);
+		voxel = storage.findFirstVoxelAlongSegment(segment, isTwo, &hitPosition);
+		REQUIRE_EQUAL(voxel != nullptr, expectedTwo);
+		if (expectedTwo) {
+			REQUIRE_EQUAL(hitPosition, expectedPosition);
+			REQUIRE_EQUAL(*voxel, 2u);
+		}
+	}
+}